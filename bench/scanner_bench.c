@@ -0,0 +1,213 @@
+// Times the delimiter scan variants on the calls the parser makes for real browser requests.
+//
+// Built with the flags of the Dockerfile, from the repository root:
+//   gcc -std=gnu99 -Wall -Wpedantic -Wextra -Wfloat-equal -Wfloat-conversion -Wvla -Iinc/http -O2 -o scanner_bench bench/scanner_bench.c
+//   ./scanner_bench [rounds]
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// The variants are static, so the scanner is compiled into the benchmark.
+#include "../src/http/scanner.c"
+
+#define BENCH_DEFAULT_ROUNDS 200000
+#define BENCH_MAX_CALLS 64
+
+typedef uint32_t (*scan_function_t)(const char *data, uint32_t from, uint32_t to, char limit);
+
+typedef struct {
+    const char *name;
+    const char *data;
+    uint32_t length;
+    uint32_t calls_count;
+    uint32_t from[BENCH_MAX_CALLS];
+    char limits[BENCH_MAX_CALLS];
+} bench_sample_t;
+
+static const char chrome_navigation[] =
+    "GET /docs/guide/getting-started.html?utm_source=newsletter&utm_medium=email HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "Connection: keep-alive\r\n"
+    "sec-ch-ua: \"Chromium\";v=\"124\", \"Google Chrome\";v=\"124\", \"Not-A.Brand\";v=\"99\"\r\n"
+    "sec-ch-ua-mobile: ?0\r\n"
+    "sec-ch-ua-platform: \"Windows\"\r\n"
+    "Upgrade-Insecure-Requests: 1\r\n"
+    "User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) "
+    "Chrome/124.0.0.0 Safari/537.36\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,image/apng,*/*;q=0.8,"
+    "application/signed-exchange;v=b3;q=0.7\r\n"
+    "Sec-Fetch-Site: same-origin\r\n"
+    "Sec-Fetch-Mode: navigate\r\n"
+    "Sec-Fetch-User: ?1\r\n"
+    "Sec-Fetch-Dest: document\r\n"
+    "Referer: https://www.example.com/docs/\r\n"
+    "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+    "Accept-Language: en-US,en;q=0.9,de;q=0.8\r\n"
+    "Cookie: _ga=GA1.1.1843209921.1712345678; _ga_X1Y2Z3=GS1.1.1712345678.3.1.1712349999.0.0.0; "
+    "session=eyJ1aWQiOjQyLCJyb2xlIjoicmVhZGVyIn0.ZhQ2mA.kq3pRZ7Jm1lWc0; theme=dark; consent=analytics%3Dtrue\r\n"
+    "If-None-Match: \"ce80c7-6ad407ab3459ef30-33\"\r\n"
+    "If-Modified-Since: Sat, 17 Oct 2026 23:41:31 GMT\r\n"
+    "\r\n";
+
+static const char firefox_script[] =
+    "GET /static/js/vendor.3f9a1c2e.chunk.js HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:125.0) Gecko/20100101 Firefox/125.0\r\n"
+    "Accept: */*\r\n"
+    "Accept-Language: en-US,en;q=0.5\r\n"
+    "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+    "Referer: https://www.example.com/docs/guide/getting-started.html\r\n"
+    "Connection: keep-alive\r\n"
+    "Cookie: _ga=GA1.1.1843209921.1712345678; session=eyJ1aWQiOjQyLCJyb2xlIjoicmVhZGVyIn0.ZhQ2mA.kq3pRZ7Jm1lWc0\r\n"
+    "Sec-Fetch-Dest: script\r\n"
+    "Sec-Fetch-Mode: no-cors\r\n"
+    "Sec-Fetch-Site: same-origin\r\n"
+    "If-Modified-Since: Fri, 16 Oct 2026 08:12:55 GMT\r\n"
+    "If-None-Match: \"ce8106-6ad4083305251895-1717b\"\r\n"
+    "\r\n";
+
+static const char safari_image[] =
+    "GET /assets/img/hero-1920x1080.webp HTTP/1.1\r\n"
+    "Host: cdn.example.com\r\n"
+    "Accept: image/webp,image/avif,image/jxl,image/heic,image/heic-sequence,video/*;q=0.8,image/png,image/svg+xml,"
+    "image/*;q=0.8,*/*;q=0.5\r\n"
+    "Sec-Fetch-Site: same-site\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Sec-Fetch-Mode: no-cors\r\n"
+    "Accept-Language: en-GB,en;q=0.9\r\n"
+    "User-Agent: Mozilla/5.0 (Macintosh; Intel Mac OS X 10_15_7) AppleWebKit/605.1.15 (KHTML, like Gecko) "
+    "Version/17.4.1 Safari/605.1.15\r\n"
+    "Referer: https://www.example.com/\r\n"
+    "Connection: keep-alive\r\n"
+    "Sec-Fetch-Dest: image\r\n"
+    "\r\n";
+
+static const char chrome_heavy_cookies[] =
+    "GET /account/settings/notifications HTTP/1.1\r\n"
+    "Host: app.example.com\r\n"
+    "Connection: keep-alive\r\n"
+    "Cache-Control: max-age=0\r\n"
+    "sec-ch-ua: \"Chromium\";v=\"124\", \"Google Chrome\";v=\"124\", \"Not-A.Brand\";v=\"99\"\r\n"
+    "sec-ch-ua-mobile: ?0\r\n"
+    "sec-ch-ua-platform: \"macOS\"\r\n"
+    "Upgrade-Insecure-Requests: 1\r\n"
+    "User-Agent: Mozilla/5.0 (Macintosh; Intel Mac OS X 10_15_7) AppleWebKit/537.36 (KHTML, like Gecko) "
+    "Chrome/124.0.0.0 Safari/537.36\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,image/apng,*/*;q=0.8,"
+    "application/signed-exchange;v=b3;q=0.7\r\n"
+    "Sec-Fetch-Site: none\r\n"
+    "Sec-Fetch-Mode: navigate\r\n"
+    "Sec-Fetch-User: ?1\r\n"
+    "Sec-Fetch-Dest: document\r\n"
+    "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+    "Accept-Language: en-US,en;q=0.9\r\n"
+    "Cookie: _ga=GA1.1.1843209921.1712345678; _ga_X1Y2Z3=GS1.1.1712345678.3.1.1712349999.0.0.0; "
+    "_gid=GA1.2.771023411.1712345678; _fbp=fb.1.1712345678901.1234567890; "
+    "ajs_anonymous_id=%2242c1b2d4-6f1e-4d3b-9a8e-0f3c2b1a9d8e%22; ajs_user_id=%22u_8c2f1a%22; "
+    "intercom-session-abc123=Q2xWbjZ2eE1sT0F6N0pGbHJ6c2ZQd0xOa3Vhd2xQbHh6RHJ6R0pQd0xOa3Vh--3f2a1b; "
+    "csrftoken=Zm9vYmFyYmF6cXV4cXV1eGNvcmdlZ3JhdWx0Z2FycGx5; "
+    "session=eyJ1aWQiOjQyLCJyb2xlIjoiYWRtaW4iLCJleHAiOjE3MTIzNDk5OTl9.ZhQ2mA.kq3pRZ7Jm1lWc0Yq9d2N; "
+    "theme=dark; tz=Europe%2FBerlin; consent=analytics%3Dtrue%26ads%3Dfalse\r\n"
+    "\r\n";
+
+static bench_sample_t samples[] = {
+    {.name = "chrome navigation", .data = chrome_navigation, .length = sizeof(chrome_navigation) - 1},
+    {.name = "firefox script", .data = firefox_script, .length = sizeof(firefox_script) - 1},
+    {.name = "safari image", .data = safari_image, .length = sizeof(safari_image) - 1},
+    {.name = "chrome heavy cookies", .data = chrome_heavy_cookies, .length = sizeof(chrome_heavy_cookies) - 1},
+};
+
+#define SAMPLES_COUNT (sizeof(samples) / sizeof(samples[0]))
+
+// Records where the parser calls the scanner: after the first byte of the request-target and after the first
+// byte of each header value.
+static void plan_calls(bench_sample_t *sample) {
+    const char *data = sample->data;
+    const char *path = strchr(data, ' ') + 1;
+    sample->from[sample->calls_count] = (uint32_t)(path - data) + 1;
+    sample->limits[sample->calls_count++] = HTTP_SCAN_CTL_OR_SPACE;
+
+    for (const char *line = strstr(data, "\r\n") + 2; line[0] != '\r'; line = strstr(line, "\r\n") + 2) {
+        const char *value = strchr(line, ':') + 1;
+        while (*value == ' ') {
+            value++;
+        }
+        if (sample->calls_count < BENCH_MAX_CALLS) {
+            sample->from[sample->calls_count] = (uint32_t)(value - data) + 1;
+            sample->limits[sample->calls_count++] = HTTP_SCAN_CTL;
+        }
+    }
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static volatile uint32_t sink;
+
+// Returns nanoseconds per request for one variant over all samples.
+static double run(scan_function_t scan, unsigned rounds, uint64_t *checksum) {
+    uint64_t sum = 0;
+    uint64_t start = now_ns();
+    for (unsigned r = 0; r < rounds; r++) {
+        for (size_t s = 0; s < SAMPLES_COUNT; s++) {
+            const bench_sample_t *sample = &samples[s];
+            for (uint32_t c = 0; c < sample->calls_count; c++) {
+                sum += scan(sample->data, sample->from[c], sample->length, sample->limits[c]);
+            }
+        }
+    }
+    uint64_t elapsed = now_ns() - start;
+    sink = (uint32_t)sum;
+    *checksum = sum;
+
+    return (double)elapsed / ((double)rounds * (double)SAMPLES_COUNT);
+}
+
+int main(int argc, char *argv[]) {
+    unsigned rounds = argc > 1 ? (unsigned)strtoul(argv[1], NULL, 10) : BENCH_DEFAULT_ROUNDS;
+    if (rounds == 0) {
+        rounds = BENCH_DEFAULT_ROUNDS;
+    }
+
+    uint32_t total = 0;
+    for (size_t s = 0; s < SAMPLES_COUNT; s++) {
+        plan_calls(&samples[s]);
+        total += samples[s].length;
+        printf("%-22s %5u bytes %3u scans\n", samples[s].name, samples[s].length, samples[s].calls_count);
+    }
+
+    struct {
+        const char *name;
+        scan_function_t scan;
+    } variants[] = {
+        {"scalar", scan_scalar},
+#ifdef HTTP_SCANNER_X86
+        {"sse2", scan_sse2},
+#endif
+        {"exported", http_scan_delimiter},
+    };
+
+    uint64_t expected = 0;
+    double scalar_ns = 0;
+    printf("\n%-10s %10s %10s %8s\n", "variant", "ns/request", "MB/s", "speedup");
+    for (size_t v = 0; v < sizeof(variants) / sizeof(variants[0]); v++) {
+        uint64_t checksum;
+        run(variants[v].scan, rounds / 10 + 1, &checksum);
+        double ns = run(variants[v].scan, rounds, &checksum);
+        if (v == 0) {
+            expected = checksum;
+            scalar_ns = ns;
+        } else if (checksum != expected) {
+            fprintf(stderr, "%s disagrees with scalar\n", variants[v].name);
+            return EXIT_FAILURE;
+        }
+        double mb_per_s = (double)total / (double)SAMPLES_COUNT / ns * 1000.0;
+        printf("%-10s %10.1f %10.1f %7.2fx\n", variants[v].name, ns, mb_per_s, scalar_ns / ns);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,64 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdlib.h>
+#include "server.h"
+#include "cpu_affinity.h"
+
+#define DEFAULT_PORT 8080
+#define DEFAULT_CONN_QUEUE_LEN 1024
+#define DEFAULT_WORKERS_PER_CPU 4
+#define MAX_WORKERS_LIMIT 4096
+#define DEFAULT_SPAWN_LATENCY_US 2000
+#define DEFAULT_WORKER_IDLE_TIMEOUT_MS 30000
+#define DEFAULT_QUEUE_DEPTH 256
+#define DEFAULT_KEEP_ALIVE_TIMEOUT_MS 15000
+#define DEFAULT_KEEP_ALIVE_REQUESTS 1000
+#define MAX_CONNECTIONS_LIMIT (1 << 20)
+#define DEFAULT_FILE_CACHE_SIZE (64L * 1024 * 1024)
+#define DEFAULT_FILE_CACHE_ENTRIES 4096
+#define DEFAULT_FILE_CACHE_MAX_FILE_SIZE (1024L * 1024)
+#define DEFAULT_OPEN_FILE_CACHE_SIZE 1024
+#define DEFAULT_COMPRESSION_LEVEL 6
+#define DEFAULT_COMPRESSION_MIN_SIZE 1024
+#define DEFAULT_COMPRESSION_CACHE_SIZE (32L * 1024 * 1024)
+#define DEFAULT_MIME_TYPES_PATH "/etc/mime.types"
+#define DEFAULT_MIME_TYPE "application/octet-stream"
+
+typedef enum server_mode {
+    SERVER_MODE_POOL,       // one acceptor hands connections to the worker pool
+    SERVER_MODE_REACTORS,   // every reactor thread owns a SO_REUSEPORT listener and serves its connections inline
+} server_mode_t;
+
+typedef struct config {
+    int port;
+    int conn_queue_len;
+    server_mode_t mode;
+    server_backend_t backend;
+    size_t reactors;
+    cpu_affinity_t cpu_affinity;    // pins reactors or workers and steers connections to the receiving cpu
+    size_t min_workers;
+    size_t max_workers;
+    unsigned spawn_latency_us;      // queue wait that makes the pool add a worker
+    unsigned worker_idle_timeout_ms;    // idle time after which a worker above min_workers exits
+    size_t queue_depth;         // connections waiting on each worker before the acceptor blocks
+    size_t max_connections;
+    int keep_alive_timeout_ms;
+    unsigned keep_alive_requests;
+    const char *error_pages;    // directory with <code>.html pages, or NULL for the built-in ones
+    size_t file_cache_size;     // 0 turns the in-memory file cache off
+    size_t file_cache_entries;
+    size_t file_cache_max_file_size;
+    size_t open_file_cache_size;    // descriptors of larger files kept open; 0 turns that off
+    int compression_level;          // zlib level of on-the-fly compression; 0 turns it off
+    size_t compression_min_size;
+    size_t compression_cache_size;
+    const char *mime_types;         // mime.types file read on top of the built-in table
+    const char *default_type;       // Content-Type of files with an unknown extension
+    const char *charset;            // appended to textual types, or NULL
+} config_t;
+
+// Fills config with defaults overridden by the STATIC_SERVER_* environment variables.
+int config_load(config_t *config);
+
+#endif //CONFIG_H
@@ -0,0 +1,27 @@
+#ifndef CPU_AFFINITY_H
+#define CPU_AFFINITY_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#define CPU_AFFINITY_NO_SLOT SIZE_MAX
+
+typedef enum cpu_affinity {
+    CPU_AFFINITY_OFF,
+    CPU_AFFINITY_CPU,   // thread i runs on the i-th available cpu only
+    CPU_AFFINITY_NODE,  // thread i runs on any cpu of the NUMA node of the i-th available cpu
+} cpu_affinity_t;
+
+// Takes the cpus of the process affinity mask as slots, in ascending order, and their NUMA nodes from sysfs.
+int cpu_affinity_init(cpu_affinity_t mode);
+// Pins the calling thread to slot index modulo the number of cpus; does nothing when affinity is off.
+int cpu_affinity_pin(size_t index);
+// Returns the cpu of slot index modulo the number of cpus, or -1 when affinity is off.
+int cpu_affinity_cpu_of(size_t index);
+// Returns the number of slots, 0 when affinity is off.
+size_t cpu_affinity_slots(void);
+// Returns the slot of the cpu that received the socket's packets (SO_INCOMING_CPU), or CPU_AFFINITY_NO_SLOT.
+size_t cpu_affinity_slot_of_socket(int socket_fd);
+void cpu_affinity_destroy(void);
+
+#endif //CPU_AFFINITY_H
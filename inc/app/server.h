@@ -1,10 +1,26 @@
 #ifndef SERVER_H
 #define SERVER_H
 
+#include <stdlib.h>
+#include <stdbool.h>
+
+typedef enum server_backend {
+    SERVER_BACKEND_EPOLL,
+    SERVER_BACKEND_IO_URING,    // falls back to epoll when the kernel refuses io_uring
+} server_backend_t;
+
 typedef struct server *server_t;
 
-int server_create(server_t *server);
-int server_run(server_t server, int port, int conn_queue_len, void(*handle_request)(int));
+// With pin_reactors, reactor i runs on cpu affinity slot i and the kernel steers each connection to the reactor
+// on the cpu that received it.
+int server_create(server_t *server, size_t reactors_count, server_backend_t backend, size_t max_connections,
+                  bool pin_reactors);
+int server_run(server_t server, int port, int conn_queue_len, int idle_timeout_ms, void(*handle_request)(int));
+// Gives a kept-alive socket back to its reactor until the next request arrives or idle_timeout_ms passes. With
+// writing, it waits for room in its send buffer instead, for up to 30 seconds.
+int server_resume(server_t server, int fd, bool writing);
+// Makes server_run() return. Async-signal-safe: it only clears the running flag and wakes the reactors.
+int server_interrupt(server_t server);
 void server_stop(server_t server);
 void server_destroy(server_t *server);
 
@@ -2,15 +2,41 @@
 #define THREAD_POOL_H
 
 #include <stdlib.h>
+#include <stdint.h>
 
-typedef void *thread_pool_task_t;
+#define THREAD_POOL_CACHE_LINE 64
+// Empty polls of the queues before a worker or a submitter parks on its futex.
+#define THREAD_POOL_SPIN_COUNT 64
+
+#define THREAD_POOL_STOPPED (-2)
+#define THREAD_POOL_RETIRED (-3)
+#define THREAD_POOL_ANY_WORKER SIZE_MAX
+
+// Copied by value into a preallocated queue slot, so a hand-off never touches the allocator.
+typedef struct thread_pool_task {
+    int socket_fd;
+    uint64_t queued_at_ns;  // CLOCK_MONOTONIC, stamped by thread_pool_submit
+} thread_pool_task_t;
 typedef struct thread_pool *thread_pool_t;
 
-int thread_pool_create(thread_pool_t *pool, size_t capacity);
+// Every worker owns a bounded lock-free FIFO of at least queue_depth slots, rounded up to a power of two. A worker
+// serves its own queue first and steals from the others when it runs dry.
+// Worker i is pinned to cpu affinity slot i, so a task for the socket's incoming cpu slot runs on that cpu.
+// The pool runs min_workers and adds one, up to max_workers, whenever a task is held back by more than
+// spawn_latency_us; a worker above min_workers exits after idle_timeout_ms without work.
+int thread_pool_create(thread_pool_t *pool, size_t min_workers, size_t max_workers, size_t queue_depth,
+                       unsigned spawn_latency_us, unsigned idle_timeout_ms);
 int thread_pool_start(thread_pool_t pool, void *(*worker_thread)(void *));
-int thread_pool_submit(thread_pool_t pool, thread_pool_task_t task);
+// Queues the task on worker, or on the least loaded one for THREAD_POOL_ANY_WORKER or when that queue is full.
+// Blocks while every queue is full, so a flood of connections backs up into the listen queue.
+int thread_pool_submit(thread_pool_t pool, size_t worker, thread_pool_task_t task);
+// Blocks until a task arrives, which is copied into task; returns THREAD_POOL_STOPPED once the pool is being stopped
+// and THREAD_POOL_RETIRED when the calling worker is no longer needed. Either way the worker has to return.
 int thread_pool_take_task(thread_pool_task_t *task, thread_pool_t pool);
-void thread_pool_cleanup_handler(void *pool);
+// Index of the calling worker, or THREAD_POOL_ANY_WORKER outside of the pool.
+size_t thread_pool_current_worker(void);
+void thread_pool_get_size(thread_pool_t pool, size_t *live_workers, size_t *idle_workers);
+// Wakes every worker and waits until each has returned from the task it was running.
 int thread_pool_stop(thread_pool_t pool);
 void thread_pool_destroy(thread_pool_t *pool);
 
@@ -0,0 +1,33 @@
+#ifndef HTTP_COMPRESSION_H
+#define HTTP_COMPRESSION_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+
+#define COMPRESSION_CACHE_SHARDS 16
+#define COMPRESSION_CACHE_SHARD_BUCKETS 64
+#define COMPRESSION_READ_BUFFER_SIZE (64 * 1024)
+
+typedef enum http_compression {
+    HTTP_COMPRESSION_GZIP,
+    HTTP_COMPRESSION_DEFLATE,   // the zlib format, which is what HTTP calls deflate
+} http_compression_t;
+
+typedef struct compressed_variant *compressed_variant_t;
+
+// Compresses responses with zlib at level, 1 to 9; level 0 turns compression off. Variants are cached up to
+// cache_size bytes, and files larger than a cache shard are never compressed.
+int compression_init(int level, size_t min_size, size_t cache_size);
+// Tells whether a file of length bytes is worth compressing.
+bool compression_accepts(size_t length);
+// Returns a referenced variant of the file at path as of mtime, compressing it on a miss: from data when it is not
+// NULL, and from fd, read at explicit offsets, otherwise.
+int compression_get(const char *path, struct timespec mtime, http_compression_t coding, const char *data, int fd,
+                    size_t length, compressed_variant_t *variant);
+int compressed_variant_get_data(compressed_variant_t variant, const char **data, size_t *length);
+// The data stays valid until the last reference is released, even if the variant is evicted meanwhile.
+void compressed_variant_release(compressed_variant_t *variant);
+void compression_destroy(void);
+
+#endif //HTTP_COMPRESSION_H
@@ -6,6 +6,9 @@
 
 #define STATIC_PATH "/tmp/static"
 
-int make_decision(http_request_t request, http_response_t *response, http_status_code_t *status_code);
+// The response is allocated in arena; error responses need http_prebuilt_responses_init() to have run.
+int make_decision(http_request_t request, arena_t arena, http_response_t *response, http_status_code_t *status_code);
+// Builds the response to a request that could not be parsed.
+int make_error_decision(http_status_code_t status_code, arena_t arena, http_response_t *response);
 
 #endif //DECISIONS_MAKER_H
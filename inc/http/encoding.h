@@ -0,0 +1,13 @@
+#ifndef HTTP_ENCODING_H
+#define HTTP_ENCODING_H
+
+#define HTTP_QVALUE_MAX 1000
+
+// Returns the weight, 0 to HTTP_QVALUE_MAX, that an Accept-Encoding value gives coding. A coding that is not
+// listed gets the weight of "*", or 0 without one; identity stays acceptable unless it is refused explicitly.
+unsigned http_accept_encoding_weight(const char *accept_encoding, const char *coding);
+// The weight identity competes with when a coding is picked: what the client gives it by name or through "*", and
+// 0 when it lists neither, so an unlisted identity never outranks a coding the client asked for.
+unsigned http_accept_encoding_identity_rank(const char *accept_encoding);
+
+#endif //HTTP_ENCODING_H
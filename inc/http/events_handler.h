@@ -1,8 +1,24 @@
 #ifndef HTTP_EVENTS_HANDLER_H
 #define HTTP_EVENTS_HANDLER_H
 
-#define REQUEST_BUFFER_SIZE 1024
+#include <stdlib.h>
+#include <stdbool.h>
+#include "parser.h"
 
-int handle_http_event(int socket_fd);
+#define REQUEST_BUFFER_SIZE HTTP_MAX_REQUEST_HEAD_SIZE
+
+// Allocates per-connection state for socket fds below max_connections.
+int http_events_init(size_t max_connections, unsigned max_requests_per_connection);
+// What a socket waits for once an event on it has been handled.
+typedef enum http_event_next {
+    HTTP_EVENT_CLOSE,
+    HTTP_EVENT_READ,            // the next request
+    HTTP_EVENT_WRITE,           // room for the rest of the responses, which never block the handler
+} http_event_next_t;
+
+// Answers the requests that arrived, or goes on sending the responses that did not fit into the socket before.
+int handle_http_event(int socket_fd, http_event_next_t *next);
+void http_events_close(int socket_fd);
+void http_events_destroy(void);
 
 #endif //HTTP_EVENTS_HANDLER_H
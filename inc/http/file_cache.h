@@ -0,0 +1,36 @@
+#ifndef HTTP_FILE_CACHE_H
+#define HTTP_FILE_CACHE_H
+
+#include <stdlib.h>
+#include <time.h>
+#include <sys/types.h>
+
+#define FILE_CACHE_SHARDS 16
+#define FILE_CACHE_SHARD_BUCKETS 256
+
+#define FILE_CACHE_MISS (-3)
+
+typedef struct file_cache_entry *file_cache_entry_t;
+
+// Keeps the content of files under root up to max_file_size in memory, and up to max_open_files descriptors of
+// larger ones open together with their size. Entries are dropped as soon as inotify reports a change below root,
+// so a hit never returns stale data. Either part is off when its limits are 0.
+int file_cache_init(const char *root, size_t max_bytes, size_t max_entries, size_t max_file_size,
+                    size_t max_open_files);
+// Returns EXIT_SUCCESS with a referenced entry on a hit and FILE_CACHE_MISS otherwise. No syscalls are made.
+int file_cache_lookup(const char *path, file_cache_entry_t *entry);
+// Reads the file into the cache, or keeps it open when it is too large, and returns a referenced entry; FILE_CACHE_MISS means the file is not cacheable
+// and has to be served from disk.
+int file_cache_load(const char *path, const char *content_type, file_cache_entry_t *entry);
+// data is NULL for a file that is only kept open; length is the file size either way.
+int file_cache_entry_get_data(file_cache_entry_t entry, const char **data, size_t *length);
+// Returns -1 for a file kept in memory. The descriptor is shared: read it only at explicit offsets and never close it.
+int file_cache_entry_get_fd(file_cache_entry_t entry, int *fd);
+int file_cache_entry_get_content_type(file_cache_entry_t entry, const char **content_type);
+int file_cache_entry_get_mtime(file_cache_entry_t entry, struct timespec *mtime);
+int file_cache_entry_get_inode(file_cache_entry_t entry, ino_t *inode);
+// Drops the reference taken by lookup or load; the content stays valid until then even if the entry is evicted.
+void file_cache_release(file_cache_entry_t *entry);
+void file_cache_destroy(void);
+
+#endif //HTTP_FILE_CACHE_H
@@ -10,7 +10,7 @@
 
 typedef struct http_headers *http_headers_t;
 
-int http_headers_create(http_headers_t *headers, const size_t capacity);
+int http_headers_create(http_headers_t *headers, arena_t arena, const size_t capacity);
 int http_headers_append(http_headers_t headers, const http_header_t header);
 int http_headers_set_header(http_headers_t headers, const char *name, const char *value); // TODO: search for replace
 int http_headers_create_header(http_headers_t headers, const char *raw_header);
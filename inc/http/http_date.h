@@ -0,0 +1,15 @@
+#ifndef HTTP_DATE_H
+#define HTTP_DATE_H
+
+#include <time.h>
+
+#define INVALID_HTTP_DATE (-2)
+// An IMF-fixdate and its terminating NUL.
+#define HTTP_DATE_SIZE 30
+
+// Parses an IMF-fixdate such as "Sun, 06 Nov 1994 08:49:37 GMT", the only format HTTP/1.1 senders may generate.
+int http_date_parse(const char *value, time_t *date);
+// Formats date as an IMF-fixdate into buf, which must hold HTTP_DATE_SIZE bytes.
+int http_date_format(time_t date, char *buf, size_t size);
+
+#endif //HTTP_DATE_H
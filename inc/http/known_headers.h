@@ -0,0 +1,46 @@
+#ifndef HTTP_KNOWN_HEADERS_H
+#define HTTP_KNOWN_HEADERS_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+// Request headers the server acts on. The parser records where each of them is while it reads the head,
+// so looking one up afterwards is an array access.
+typedef enum http_known_header {
+    HTTP_HEADER_HOST,
+    HTTP_HEADER_CONNECTION,
+    HTTP_HEADER_CONTENT_LENGTH,
+    HTTP_HEADER_TRANSFER_ENCODING,
+    HTTP_HEADER_EXPECT,
+    HTTP_HEADER_UPGRADE,
+    HTTP_HEADER_ACCEPT,
+    HTTP_HEADER_ACCEPT_ENCODING,
+    HTTP_HEADER_ACCEPT_LANGUAGE,
+    HTTP_HEADER_RANGE,
+    HTTP_HEADER_IF_RANGE,
+    HTTP_HEADER_IF_MATCH,
+    HTTP_HEADER_IF_NONE_MATCH,
+    HTTP_HEADER_IF_MODIFIED_SINCE,
+    HTTP_HEADER_IF_UNMODIFIED_SINCE,
+    HTTP_HEADER_CACHE_CONTROL,
+    HTTP_HEADER_AUTHORIZATION,
+    HTTP_HEADER_COOKIE,
+    HTTP_HEADER_REFERER,
+    HTTP_HEADER_USER_AGENT,
+    HTTP_KNOWN_HEADERS_COUNT,
+    HTTP_HEADER_UNKNOWN = HTTP_KNOWN_HEADERS_COUNT,
+} http_known_header_t;
+
+#define HTTP_HEADER_HASH_SEED 2166136261u
+
+// One step of the case-insensitive FNV-1a hash of a header name, so the parser can hash names as it reads them.
+static inline uint32_t http_header_hash_step(uint32_t hash, char c) {
+    unsigned char lower = (unsigned char)(c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c);
+    return (hash ^ lower) * 16777619u;
+}
+
+// Classifies a header name case-insensitively with a switch on its length and first character and at most
+// one comparison.
+http_known_header_t http_known_header_of(const char *name, size_t length);
+
+#endif //HTTP_KNOWN_HEADERS_H
@@ -0,0 +1,15 @@
+#ifndef HTTP_MIME_TYPES_H
+#define HTTP_MIME_TYPES_H
+
+#include <stdlib.h>
+
+#define MIME_EXTENSION_MAX 32
+
+// Builds the extension table from a built-in list of common types, then from the mime.types file at path, whose
+// entries win; a missing file is not an error. charset, when not NULL, is appended to textual types.
+int mime_types_init(const char *path, const char *default_type, const char *charset);
+// Returns the Content-Type for the extension of path, or the default type. The result lives until mime_types_destroy().
+const char *mime_type_of(const char *path);
+void mime_types_destroy(void);
+
+#endif //HTTP_MIME_TYPES_H
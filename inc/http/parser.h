@@ -0,0 +1,60 @@
+#ifndef HTTP_PARSER_H
+#define HTTP_PARSER_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "known_headers.h"
+
+#define HTTP_MAX_REQUEST_HEAD_SIZE 8192
+#define HTTP_MAX_HEADERS 64
+// Open-addressing table of the other header names; a power of two at least twice HTTP_MAX_HEADERS.
+#define HTTP_UNKNOWN_HEADER_SLOTS 128
+
+#define HTTP_PARSER_DONE 0
+#define HTTP_PARSER_AGAIN 1
+#define HTTP_PARSER_INVALID (-1)
+#define HTTP_PARSER_TOO_LARGE (-2)
+
+// Part of a request head, relative to the first byte of the request.
+typedef struct http_slice {
+    uint32_t offset;
+    uint32_t length;
+} http_slice_t;
+
+typedef enum http_parser_state {
+    HTTP_PARSER_METHOD,
+    HTTP_PARSER_PATH,
+    HTTP_PARSER_PROTO,
+    HTTP_PARSER_PROTO_LF,
+    HTTP_PARSER_HEADER_START,
+    HTTP_PARSER_HEADER_NAME,
+    HTTP_PARSER_HEADER_VALUE_START,
+    HTTP_PARSER_HEADER_VALUE,
+    HTTP_PARSER_HEADER_LF,
+    HTTP_PARSER_END_LF,
+} http_parser_state_t;
+
+// Resumable request head parser: feed it the bytes received so far and call it again when more arrive.
+// Every token is NUL-terminated in place, so slices can be used as C strings once parsing is done.
+// Header names are indexed as they are read: both tables hold the index + 1 of the first header with a name, 0 for none.
+typedef struct http_parser {
+    http_parser_state_t state;
+    uint32_t position;
+    uint32_t mark;
+    uint32_t value_end;
+    http_slice_t method;
+    http_slice_t path;
+    http_slice_t proto;
+    http_slice_t header_names[HTTP_MAX_HEADERS];
+    http_slice_t header_values[HTTP_MAX_HEADERS];
+    size_t headers_count;
+    uint32_t name_hash;
+    uint8_t known_headers[HTTP_KNOWN_HEADERS_COUNT];
+    uint8_t unknown_headers[HTTP_UNKNOWN_HEADER_SLOTS];
+} http_parser_t;
+
+void http_parser_reset(http_parser_t *parser);
+// Parses data[parser->position..length); on HTTP_PARSER_DONE parser->position is the size of the request head.
+int http_parser_execute(http_parser_t *parser, char *data, size_t length);
+
+#endif //HTTP_PARSER_H
@@ -0,0 +1,25 @@
+#ifndef HTTP_PREBUILT_RESPONSES_H
+#define HTTP_PREBUILT_RESPONSES_H
+
+#include <stdlib.h>
+#include "response.h"
+
+#define ERROR_PAGE_MAX_SIZE (64 * 1024)
+
+// A fixed response serialized once at startup. raw[keep_alive] holds the complete head with the matching
+// Connection header, followed by the HTML body; both variants share the body length.
+typedef struct http_prebuilt_response {
+    http_status_code_t status_code;
+    char *raw[2];
+    size_t head_length[2];
+    size_t body_length;
+} http_prebuilt_response_t;
+
+// Builds the error responses. The body of each is read from <error_pages_dir>/<code>.html when that file
+// exists and a built-in page is used otherwise; error_pages_dir may be NULL.
+int http_prebuilt_responses_init(const char *error_pages_dir);
+// Returns NULL for a status without a prebuilt response.
+const http_prebuilt_response_t *http_prebuilt_response_find(http_status_code_t status_code);
+void http_prebuilt_responses_destroy(void);
+
+#endif //HTTP_PREBUILT_RESPONSES_H
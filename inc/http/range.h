@@ -0,0 +1,21 @@
+#ifndef HTTP_RANGE_H
+#define HTTP_RANGE_H
+
+#include <stdlib.h>
+#include <sys/types.h>
+
+#define HTTP_MAX_RANGES 16
+
+#define HTTP_RANGE_IGNORED 1        // no usable Range header: the whole representation is sent
+#define HTTP_RANGE_UNSATISFIABLE 2  // no range overlaps the representation: 416
+
+typedef struct http_range {
+    off_t offset;
+    size_t length;
+} http_range_t;
+
+// Parses a Range header value against a representation of length bytes into at most capacity ranges.
+// Invalid values, units other than bytes and requests for more than capacity ranges are ignored, as RFC 9110 allows.
+int http_range_parse(const char *value, size_t length, http_range_t *ranges, size_t capacity, size_t *count);
+
+#endif //HTTP_RANGE_H
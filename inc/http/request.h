@@ -2,6 +2,9 @@
 #define HTTP_REQUEST_H
 
 #include <time.h>
+#include "parser.h"
+#include "headers.h"
+#include "arena.h"
 
 #define INVALID_HTTP_REQUEST (-2)
 
@@ -37,13 +40,17 @@ typedef char *http_proto_t;
 
 typedef struct http_request *http_request_t;
 
-int http_request_create(http_request_t *request, const char *raw_request);
+// raw_request must outlive the request: path, proto and header values point into it.
+// The request itself is allocated in arena and released with it.
+int http_request_create(http_request_t *request, arena_t arena, char *raw_request, const http_parser_t *head);
 int http_request_compute_processing_time_ms(http_request_t request, clock_t *diff);
 int http_request_get_method(http_request_t request, http_method_t *method);
 int http_request_get_path(http_request_t request, char **path);
 int http_request_get_proto(http_request_t request, char **proto);
+// O(1) lookup of a header the parser recognized.
+int http_request_get_header(http_request_t request, http_known_header_t header, char **value);
+// Case-insensitive lookup by name; well-known names are redirected to http_request_get_header().
 int http_request_find_header(http_request_t request, const char *name, char **value);
-int http_request_get_body(http_request_t request, char **body);
 void http_request_destroy(http_request_t *request);
 
 #endif //HTTP_REQUEST_H
@@ -1,30 +1,77 @@
 #ifndef HTTP_RESPONSE_H
 #define HTTP_RESPONSE_H
 
+#include <stdlib.h>
+#include <stdbool.h>
+#include <sys/uio.h>
 #include "header.h"
 #include "request.h"
+#include "file_cache.h"
+#include "compression.h"
 
 #define HTTP_OK                    "200 OK"
+#define HTTP_PARTIAL_CONTENT       "206 Partial Content"
+#define HTTP_NOT_MODIFIED          "304 Not Modified"
+#define HTTP_BAD_REQUEST           "400 Bad Request"
 #define HTTP_FORBIDDEN             "403 Forbidden"
 #define HTTP_NOT_FOUND             "404 Not Found"
 #define HTTP_METHOD_NOT_ALLOWED    "405 Method Not Allowed"
+#define HTTP_RANGE_NOT_SATISFIABLE "416 Range Not Satisfiable"
+#define HTTP_HEADERS_TOO_LARGE     "431 Request Header Fields Too Large"
 #define HTTP_INTERNAL_SERVER_ERROR "500 Internal Server Error"
 #define HTTP_NOT_IMPLEMENTED       "501 Not Implemented"
 
 #define HTTP_1_1 "HTTP/1.1"
 
+// The serialized head and an in-memory body.
+#define HTTP_RESPONSE_IOV_COUNT 2
+
 typedef char *http_status_code_t;
 
+// One part of a multipart/byteranges body: its boundary and headers, then a slice of the representation.
+typedef struct http_body_part {
+    const char *head;
+    size_t head_length;
+    off_t offset;
+    size_t length;
+} http_body_part_t;
+
 typedef struct http_response *http_response_t;
 
-int http_response_create(http_response_t *response);
+struct http_prebuilt_response;
+
+// The response and everything set on it are allocated in arena and released with it.
+int http_response_create(http_response_t *response, arena_t arena);
+// Sends a response serialized at startup; only the Connection variant is picked per request.
+// with_body is false for HEAD requests. Headers cannot be added to such a response.
+int http_response_create_prebuilt(http_response_t *response, arena_t arena,
+                                  const struct http_prebuilt_response *prebuilt, bool with_body);
 int http_response_set_proto(http_response_t response, http_proto_t proto);
 int http_response_set_status_code(http_response_t response, http_status_code_t status_code);
 int http_response_set_header(http_response_t response, const char *name, const char *value);
+// Sets the Connection header.
+int http_response_set_keep_alive(http_response_t response, bool keep_alive);
 int http_response_set_body(http_response_t response, const char *body);
-int http_response_set_attachment(http_response_t response, int fd);
+int http_response_set_attachment(http_response_t response, int fd, size_t size);
+// Sends a file cache entry as the body, from memory or from its shared descriptor; the response takes over the reference.
+int http_response_set_cached_body(http_response_t response, file_cache_entry_t entry);
+// Sends a compressed variant as the body; the response takes over the reference.
+int http_response_set_compressed_body(http_response_t response, compressed_variant_t variant);
+// Narrows the body set so far, in memory or attached, to length bytes starting at offset.
+int http_response_select_range(http_response_t response, off_t offset, size_t length);
+// Sends the parts followed by trailer instead of the whole body set so far. parts and trailer must live in the
+// response's arena.
+int http_response_select_parts(http_response_t response, const http_body_part_t *parts, size_t count,
+                               const char *trailer);
+// Closes the attachment and releases a cached or compressed body; must be called once the response has been sent.
 int http_response_close_attachment(http_response_t response);
-int http_response_write(http_response_t response, int fd);
+// Serializes the head into the response's arena and points iov at it and the in-memory body;
+// the entries stay valid until the arena is reset.
+int http_response_head_iov(http_response_t response, struct iovec *iov, size_t capacity, size_t *n);
+bool http_response_has_attachment(http_response_t response);
+// Sends the file or multipart body without blocking. Returns EAGAIN when the socket is full; called again once it
+// is writable, it continues where it stopped.
+int http_response_write_attachment(http_response_t response, int fd);
 void http_response_destroy(http_response_t *response);
 
 #endif //HTTP_RESPONSE_H
@@ -0,0 +1,14 @@
+#ifndef HTTP_SCANNER_H
+#define HTTP_SCANNER_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#define HTTP_SCAN_CTL 0x1f              // stop at control characters: CR, LF, TAB, DEL, ...
+#define HTTP_SCAN_CTL_OR_SPACE ' '      // stop at spaces as well
+
+// Returns the position of the first byte in data[from..to) that is at most limit or DEL, or to when there is
+// none. Runs are checked 16 bytes at a time with SSE2 on x86-64 and byte by byte elsewhere.
+uint32_t http_scan_delimiter(const char *data, uint32_t from, uint32_t to, char limit);
+
+#endif //HTTP_SCANNER_H
@@ -0,0 +1,143 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include "arena.h"
+#include "log.h"
+
+#define ARENA_ALIGNMENT (2 * sizeof(void *))
+
+struct arena_block {
+    struct arena_block *next;
+    size_t capacity;
+    size_t used;
+    unsigned char data[];
+};
+
+// Blocks form a list; allocations bump through the current block and move on to the next one when it is full.
+struct arena {
+    struct arena_block *head;
+    struct arena_block *current;
+    size_t block_size;
+};
+
+static struct arena_block *arena_block_create(size_t capacity) {
+    struct arena_block *block = malloc(sizeof(struct arena_block) + capacity);
+    if (block == NULL) {
+        log_error("arena_block_create malloc(): %s", strerror(errno));
+        return NULL;
+    }
+    block->next = NULL;
+    block->capacity = capacity;
+    block->used = 0;
+
+    return block;
+}
+
+static void *arena_block_alloc(struct arena_block *block, size_t size) {
+    uintptr_t start = (uintptr_t)(block->data + block->used);
+    size_t padding = (ARENA_ALIGNMENT - start % ARENA_ALIGNMENT) % ARENA_ALIGNMENT;
+    if (block->capacity - block->used < padding || block->capacity - block->used - padding < size) {
+        return NULL;
+    }
+    block->used += padding + size;
+
+    return (void *)(start + padding);
+}
+
+int arena_create(arena_t *arena, size_t block_size) {
+    arena_t tmp_arena = malloc(sizeof(struct arena));
+    if (tmp_arena == NULL) {
+        log_error("arena_create malloc(): %s", strerror(errno));
+        return errno;
+    }
+
+    if ((tmp_arena->head = arena_block_create(block_size)) == NULL) {
+        int rc = errno;
+        free(tmp_arena);
+        return rc;
+    }
+    tmp_arena->current = tmp_arena->head;
+    tmp_arena->block_size = block_size;
+    *arena = tmp_arena;
+
+    return EXIT_SUCCESS;
+}
+
+void *arena_alloc(arena_t arena, size_t size) {
+    void *ptr = arena_block_alloc(arena->current, size);
+    if (ptr != NULL) {
+        return ptr;
+    }
+    if (size > SIZE_MAX - ARENA_ALIGNMENT) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    // Blocks after the current one are left over from before the last reset and can be reused.
+    struct arena_block *next = arena->current->next;
+    if (next == NULL || next->capacity < size + ARENA_ALIGNMENT) {
+        size_t capacity = size + ARENA_ALIGNMENT > arena->block_size ? size + ARENA_ALIGNMENT : arena->block_size;
+        struct arena_block *block = arena_block_create(capacity);
+        if (block == NULL) {
+            return NULL;
+        }
+        block->next = next;
+        arena->current->next = block;
+        next = block;
+    }
+    next->used = 0;
+    arena->current = next;
+
+    return arena_block_alloc(next, size);
+}
+
+char *arena_strdup(arena_t arena, const char *str) {
+    size_t len = strlen(str) + 1;
+    char *copy = arena_alloc(arena, len);
+    if (copy != NULL) {
+        memcpy(copy, str, len);
+    }
+
+    return copy;
+}
+
+char *arena_sprintf(arena_t arena, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    if (length < 0) {
+        return NULL;
+    }
+
+    char *str = arena_alloc(arena, (size_t)length + 1);
+    if (str != NULL) {
+        va_start(args, format);
+        vsnprintf(str, (size_t)length + 1, format, args);
+        va_end(args);
+    }
+
+    return str;
+}
+
+void arena_reset(arena_t arena) {
+    arena->head->used = 0;
+    arena->current = arena->head;
+}
+
+void arena_destroy(arena_t *arena) {
+    if (arena == NULL || *arena == NULL) {
+        return;
+    }
+    struct arena_block *block = (*arena)->head;
+    while (block != NULL) {
+        struct arena_block *next = block->next;
+        free(block);
+        block = next;
+    }
+    free(*arena);
+    *arena = NULL;
+}
@@ -0,0 +1,17 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+typedef struct arena *arena_t;
+
+int arena_create(arena_t *arena, size_t block_size);
+// Returns memory aligned for any type, or NULL with errno set; it stays valid until the next arena_reset().
+void *arena_alloc(arena_t arena, size_t size);
+char *arena_strdup(arena_t arena, const char *str);
+char *arena_sprintf(arena_t arena, const char *format, ...) __attribute__((format(printf, 2, 3)));
+// Releases every allocation at once. Blocks are kept, so a reset arena serves the next round without malloc().
+void arena_reset(arena_t arena);
+void arena_destroy(arena_t *arena);
+
+#endif //ARENA_H
@@ -1,19 +1,29 @@
+#define _GNU_SOURCE
 #include <unistd.h>
 #include <string.h>
 #include <stdlib.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <sys/stat.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
 #include <errno.h>
 #include "fs.h"
 #include "log.h"
 
-file_type_t get_file_info(char *path, size_t *size) {
+file_type_t get_file_info(char *path, file_info_t *info) {
     struct stat s;
     int rc = stat(path, &s);
     if (rc != 0) {
-        log_error("stat %s: %s", path, strerror(errno));
+        // A missing file is an expected outcome that the caller reports.
+        if (errno != ENOENT) {
+            log_error("stat %s: %s", path, strerror(errno));
+        }
         return UNKNOWN;
     }
-    *size = s.st_size;
+    info->size = s.st_size;
+    info->mtime = s.st_mtim;
+    info->inode = s.st_ino;
 
     if (S_ISREG(s.st_mode)) {
         return REGULAR;
@@ -24,19 +34,187 @@ file_type_t get_file_info(char *path, size_t *size) {
     }
 }
 
-int copy_file(int src_fd, int dst_fd) {
-    char buf[FILE_COPY_BUFFER_SIZE];
-    ssize_t n;
-    while ((n = read(src_fd, buf, FILE_COPY_BUFFER_SIZE)) != 0) {
+// writev() for plain descriptors; flags need sendmsg(), so they are only accepted for sockets.
+static ssize_t gather_write(int fd, struct iovec *iov, int iovcnt, int flags) {
+    if (flags == 0) {
+        return writev(fd, iov, iovcnt);
+    }
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = (size_t)iovcnt;
+
+    return sendmsg(fd, &msg, flags);
+}
+
+int send_iov(int fd, struct iovec *iov, size_t iovcnt, size_t *sent, int flags) {
+    size_t i = 0;
+    size_t skip = *sent;
+    while (1) {
+        while (i < iovcnt && skip >= iov[i].iov_len) {
+            skip -= iov[i].iov_len;
+            i++;
+        }
+        if (i == iovcnt) {
+            return EXIT_SUCCESS;
+        }
+
+        // The partly sent entry is only trimmed for the call, so iov keeps describing the whole message.
+        struct iovec first = iov[i];
+        iov[i].iov_base = (char *)first.iov_base + skip;
+        iov[i].iov_len = first.iov_len - skip;
+        int chunk = iovcnt - i < IOV_MAX ? (int)(iovcnt - i) : IOV_MAX;
+        ssize_t n = gather_write(fd, iov + i, chunk, flags);
+        iov[i] = first;
         if (n == -1) {
-            log_error("copy_file read from fd %d: %s", src_fd, strerror(errno));
-            return errno;
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EWOULDBLOCK ? EAGAIN : errno;
+        }
+        *sent += (size_t)n;
+        skip += (size_t)n;
+    }
+}
+
+// A chunk that only went out in part is read again on the next call, from the advanced offset.
+static int send_file_buffered(int src_fd, int dst_fd, off_t *offset, size_t *count) {
+    void *buf = NULL;
+    int rc = posix_memalign(&buf, FILE_COPY_BUFFER_ALIGNMENT, FILE_COPY_BUFFER_SIZE);
+    if (rc != 0) {
+        log_error("send_file posix_memalign(): %s", strerror(rc));
+        return rc;
+    }
+
+    rc = EXIT_SUCCESS;
+    while (*count > 0) {
+        size_t chunk = *count < FILE_COPY_BUFFER_SIZE ? *count : FILE_COPY_BUFFER_SIZE;
+        ssize_t n = pread(src_fd, buf, chunk, *offset);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            rc = errno;
+            log_error("send_file read from fd %d: %s", src_fd, strerror(rc));
+            break;
+        }
+        if (n == 0) {
+            log_error("send_file fd %d ended %lu bytes early", src_fd, *count);
+            rc = EIO;
+            break;
+        }
+
+        for (ssize_t written = 0; written < n && rc == EXIT_SUCCESS;) {
+            ssize_t out = write(dst_fd, (char *)buf + written, (size_t)(n - written));
+            if (out == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                rc = errno == EWOULDBLOCK ? EAGAIN : errno;
+                if (rc != EAGAIN) {
+                    log_error("send_file write to fd %d: %s", dst_fd, strerror(rc));
+                }
+                break;
+            }
+            written += out;
+            *offset += out;
+            *count -= (size_t)out;
         }
-        if (write(dst_fd, buf, n) != n) {
-            log_error("copy_file write to fd %d: %s", dst_fd, strerror(errno));
+        if (rc != EXIT_SUCCESS) {
+            break;
+        }
+    }
+
+    free(buf);
+    return rc;
+}
+
+// Moves data through a pipe with splice() for sources sendfile() refuses; *offset and *count track the progress.
+static int send_file_spliced(int src_fd, int dst_fd, off_t *offset, size_t *count) {
+    int pipe_fds[2];
+    if (pipe2(pipe_fds, O_CLOEXEC) == -1) {
+        log_error("send_file pipe2(): %s", strerror(errno));
+        return errno;
+    }
+
+    int rc = EXIT_SUCCESS;
+    while (*count > 0) {
+        ssize_t in = splice(src_fd, offset, pipe_fds[1], NULL, *count, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (in == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            rc = errno;
+            break;
+        }
+        if (in == 0) {
+            log_error("send_file fd %d ended %lu bytes early", src_fd, *count);
+            rc = EIO;
+            break;
+        }
+
+        while (in > 0) {
+            // Only a chunk with more of the file behind it is corked, so the tail of the body is pushed out at once.
+            unsigned flags = (size_t)in < *count ? SPLICE_F_MOVE | SPLICE_F_MORE : SPLICE_F_MOVE;
+            ssize_t out = splice(pipe_fds[0], NULL, dst_fd, NULL, in, flags);
+            if (out == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    // What is still in the pipe is dropped with it and read from the file again next time.
+                    *offset -= in;
+                    rc = EAGAIN;
+                    goto exit;
+                }
+                // The bytes already in the pipe are lost, so there is no way to fall back from here.
+                rc = errno;
+                log_error("send_file splice() to fd %d: %s", dst_fd, strerror(rc));
+                rc = rc == EINVAL ? EIO : rc;
+                goto exit;
+            }
+            in -= out;
+            *count -= out;
+        }
+    }
+
+exit:
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+    return rc;
+}
+
+int send_file(int src_fd, int dst_fd, off_t *offset, size_t *count) {
+    int rc;
+    while (*count > 0) {
+        ssize_t n = sendfile(dst_fd, src_fd, offset, *count);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return EAGAIN;
+            }
+            if (errno == EINVAL || errno == ENOSYS) {
+                break;
+            }
+            log_error("send_file sendfile() from fd %d to fd %d: %s", src_fd, dst_fd, strerror(errno));
             return errno;
         }
+        if (n == 0) {
+            log_error("send_file fd %d ended %lu bytes early", src_fd, *count);
+            return EIO;
+        }
+        *count -= n;
+    }
+    if (*count == 0) {
+        return EXIT_SUCCESS;
+    }
+
+    if ((rc = send_file_spliced(src_fd, dst_fd, offset, count)) != EINVAL) {
+        return rc;
     }
 
-    return EXIT_SUCCESS;
+    return send_file_buffered(src_fd, dst_fd, offset, count);
 }
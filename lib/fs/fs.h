@@ -1,7 +1,14 @@
 #ifndef FS_H
 #define FS_H
 
-#define FILE_COPY_BUFFER_SIZE 1024
+#include <stddef.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+// Bounce buffer for sources that neither sendfile() nor splice() accept.
+#define FILE_COPY_BUFFER_SIZE (256 * 1024)
+#define FILE_COPY_BUFFER_ALIGNMENT 4096
 
 typedef enum file_type {
     REGULAR,
@@ -9,7 +16,20 @@ typedef enum file_type {
     UNKNOWN,
 } file_type_t;
 
-file_type_t get_file_info(char *path, size_t *size);
-int copy_file(int src_fd, int dst_fd);
+typedef struct file_info {
+    size_t size;
+    struct timespec mtime;
+    ino_t inode;
+} file_info_t;
+
+file_type_t get_file_info(char *path, file_info_t *info);
+
+// Socket sends that never block: they send what fits and return EAGAIN when the socket is full, with the progress
+// recorded for the call that continues once it is writable again.
+// Sends iov past its first *sent bytes and adds what goes out to *sent; iov itself is left as it was.
+int send_iov(int fd, struct iovec *iov, size_t iovcnt, size_t *sent, int flags);
+// Sends *count bytes of src_fd from *offset with sendfile(), falling back to splice() and then to a buffered copy, and
+// advances *offset and *count by what goes out.
+int send_file(int src_fd, int dst_fd, off_t *offset, size_t *count);
 
 #endif //FS_H
@@ -1,21 +1,73 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
 #include "log.h"
 
 #define MAX_CALLBACKS 32
 
+#define LOG_RING_RECORDS 512
+#define LOG_RECORD_SIZE 256
+#define LOG_SPEC_MAX 32
+#define LOG_LINE_MAX 2048
+#define LOG_BATCH_SIZE (64 * 1024)
+#define LOG_FLUSH_INTERVAL_MS 10
+#define LOG_CACHE_LINE 64
+
 typedef struct {
     log_log_fn fn;
     void *data;
     int level;
 } Callback;
 
+// A log_log call captured for the flusher: the format is kept as a pointer and its arguments are packed after each
+// other, strings copied in. Formats the packer does not understand are formatted right away instead.
+typedef struct {
+    const char *fmt;    // NULL when args holds the formatted message
+    const char *file;
+    time_t time;
+    int line;
+    uint16_t level;
+    uint16_t args_size;
+    unsigned char args[LOG_RECORD_SIZE - 2 * sizeof(const char *) - sizeof(time_t) - sizeof(int) - 2 * sizeof(uint16_t)];
+} Record;
+
+// Single producer (the owning thread), single consumer (the flusher). Rings of exited threads are taken over by
+// new threads and live until the process exits.
+typedef struct Ring {
+    size_t head __attribute__((aligned(LOG_CACHE_LINE)));
+    unsigned long dropped;
+    bool busy;          // the owner is inside log_log; a signal handler logging meanwhile is dropped
+    size_t tail __attribute__((aligned(LOG_CACHE_LINE)));
+    unsigned long dropped_reported;
+    int owned __attribute__((aligned(LOG_CACHE_LINE)));
+    struct Ring *next;
+    Record records[LOG_RING_RECORDS];
+} Ring;
+
 static struct {
     void *data;
     log_lock_fn lock;
     int level;
     bool quiet;
     Callback callbacks[MAX_CALLBACKS];
+    bool async;
+    bool stopping;
+    pthread_t flusher;
+    pthread_key_t ring_key;
+    Ring *rings;
 } L;
 
+enum { ARG_NONE, ARG_INT, ARG_LONG, ARG_LLONG, ARG_SIZE, ARG_INTMAX, ARG_PTRDIFF, ARG_DOUBLE, ARG_STRING,
+       ARG_POINTER, ARG_UNSUPPORTED };
+
+static __thread Ring *thread_ring = NULL;
+
 
 static const char *level_strings[] = {
         "TRACE", "DEBUG", "INFO", "WARN", "ERROR", "FATAL"
@@ -105,26 +157,462 @@ int log_add_fp(FILE *fp, int level) {
     return log_add_callback(file_callback, fp, level);
 }
 
-static void init_event(log_event *ev, void *data) {
+static void init_event(log_event *ev, void *data, struct tm *tm) {
     if (!ev->time) {
         time_t t = time(NULL);
-        ev->time = localtime(&t);
+        ev->time = localtime_r(&t, tm);
     }
     ev->data = data;
 }
 
+
+static bool is_wanted(int level) {
+    if (!L.quiet && level >= L.level) {
+        return true;
+    }
+    for (int i = 0; i < MAX_CALLBACKS && L.callbacks[i].fn; i++) {
+        if (level >= L.callbacks[i].level) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+// p points past the '%'. Returns the conversion character; type tells what va_arg has to take and stars how many
+// int arguments '*' width and precision take before it.
+static const char *parse_conversion(const char *p, int *stars, int *type) {
+    *stars = 0;
+    while (*p == '-' || *p == '+' || *p == ' ' || *p == '#' || *p == '0') {
+        p++;
+    }
+    if (*p == '*') {
+        (*stars)++;
+        p++;
+    }
+    while (*p >= '0' && *p <= '9') {
+        p++;
+    }
+    if (*p == '.') {
+        p++;
+        if (*p == '*') {
+            (*stars)++;
+            p++;
+        }
+        while (*p >= '0' && *p <= '9') {
+            p++;
+        }
+    }
+
+    int length = ARG_INT;
+    switch (*p) {
+        case 'h': p += p[1] == 'h' ? 2 : 1; break;
+        case 'l': length = p[1] == 'l' ? ARG_LLONG : ARG_LONG; p += p[1] == 'l' ? 2 : 1; break;
+        case 'z': length = ARG_SIZE; p++; break;
+        case 'j': length = ARG_INTMAX; p++; break;
+        case 't': length = ARG_PTRDIFF; p++; break;
+        case 'L': length = ARG_UNSUPPORTED; p++; break;
+        default: break;
+    }
+
+    switch (*p) {
+        case 'd': case 'i': case 'u': case 'o': case 'x': case 'X':
+            *type = length;
+            break;
+        case 'c': case 's':
+            *type = length != ARG_INT ? ARG_UNSUPPORTED : *p == 's' ? ARG_STRING : ARG_INT;
+            break;
+        case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+            *type = length == ARG_INT || length == ARG_LONG ? ARG_DOUBLE : ARG_UNSUPPORTED;
+            break;
+        case 'p':
+            *type = ARG_POINTER;
+            break;
+        case '%':
+            *type = ARG_NONE;
+            break;
+        default:
+            *type = ARG_UNSUPPORTED;
+            break;
+    }
+    return p;
+}
+
+
+#define PACK(type) \
+    do { \
+        type value = va_arg(ap, type); \
+        if (size + sizeof(value) > sizeof(record->args)) { return false; } \
+        memcpy(record->args + size, &value, sizeof(value)); \
+        size += sizeof(value); \
+    } while (0)
+
+static bool pack_args(Record *record, const char *fmt, va_list ap) {
+    size_t size = 0;
+    for (const char *p = fmt; *p; p++) {
+        if (*p != '%') {
+            continue;
+        }
+        int stars, type;
+        const char *end = parse_conversion(p + 1, &stars, &type);
+        if (type == ARG_UNSUPPORTED || end - p + 2 > LOG_SPEC_MAX) {
+            return false;
+        }
+        for (int i = 0; i < stars; i++) {
+            PACK(int);
+        }
+        switch (type) {
+            case ARG_INT: PACK(int); break;
+            case ARG_LONG: PACK(long); break;
+            case ARG_LLONG: PACK(long long); break;
+            case ARG_SIZE: PACK(size_t); break;
+            case ARG_INTMAX: PACK(intmax_t); break;
+            case ARG_PTRDIFF: PACK(ptrdiff_t); break;
+            case ARG_DOUBLE: PACK(double); break;
+            case ARG_POINTER: PACK(void *); break;
+            case ARG_STRING: {
+                const char *value = va_arg(ap, const char *);
+                if (value == NULL) {
+                    value = "(null)";
+                }
+                size_t length = strlen(value) + 1;
+                if (size + length > sizeof(record->args)) {
+                    return false;
+                }
+                memcpy(record->args + size, value, length);
+                size += length;
+                break;
+            }
+            default:
+                break;
+        }
+        p = end;
+    }
+    record->args_size = (uint16_t)size;
+    return true;
+}
+
+
+#define FORMAT(value) \
+    (stars == 0 ? snprintf(out + length, capacity - length, spec, value) \
+     : stars == 1 ? snprintf(out + length, capacity - length, spec, star[0], value) \
+     : snprintf(out + length, capacity - length, spec, star[0], star[1], value))
+
+#define UNPACK(type) \
+    do { \
+        type value; \
+        memcpy(&value, record->args + offset, sizeof(value)); \
+        offset += sizeof(value); \
+        written = FORMAT(value); \
+    } while (0)
+
+// Replays the record's format over its packed arguments, one conversion at a time.
+static size_t format_message(const Record *record, char *out, size_t capacity) {
+    if (!record->fmt) {
+        return (size_t)snprintf(out, capacity, "%s", (const char *)record->args);
+    }
+
+    size_t length = 0;
+    size_t offset = 0;
+    for (const char *p = record->fmt; *p && length + 1 < capacity; p++) {
+        if (*p != '%') {
+            out[length++] = *p;
+            continue;
+        }
+        int stars, type;
+        const char *end = parse_conversion(p + 1, &stars, &type);
+        char spec[LOG_SPEC_MAX];
+        memcpy(spec, p, (size_t)(end - p + 1));
+        spec[end - p + 1] = '\0';
+        int star[2] = {0, 0};
+        for (int i = 0; i < stars; i++) {
+            memcpy(&star[i], record->args + offset, sizeof(int));
+            offset += sizeof(int);
+        }
+
+        int written = 0;
+        switch (type) {
+            case ARG_NONE: out[length] = '%'; written = 1; break;
+            case ARG_INT: UNPACK(int); break;
+            case ARG_LONG: UNPACK(long); break;
+            case ARG_LLONG: UNPACK(long long); break;
+            case ARG_SIZE: UNPACK(size_t); break;
+            case ARG_INTMAX: UNPACK(intmax_t); break;
+            case ARG_PTRDIFF: UNPACK(ptrdiff_t); break;
+            case ARG_DOUBLE: UNPACK(double); break;
+            case ARG_POINTER: UNPACK(void *); break;
+            case ARG_STRING: {
+                const char *value = (const char *)record->args + offset;
+                offset += strlen(value) + 1;
+                written = FORMAT(value);
+                break;
+            }
+            default: break;
+        }
+        if (written > 0) {
+            length += (size_t)written < capacity - length ? (size_t)written : capacity - length - 1;
+        }
+        p = end;
+    }
+    out[length] = '\0';
+    return length;
+}
+
+
+static void release_ring(void *ring) {
+    // Cleared first: a record logged by a later destructor must not go to a ring another thread may own.
+    thread_ring = NULL;
+    __atomic_store_n(&((Ring *)ring)->owned, 0, __ATOMIC_RELEASE);
+}
+
+
+static Ring *acquire_ring(void) {
+    if (thread_ring) {
+        return thread_ring;
+    }
+
+    for (Ring *ring = __atomic_load_n(&L.rings, __ATOMIC_ACQUIRE); ring; ring = ring->next) {
+        int expected = 0;
+        if (__atomic_compare_exchange_n(&ring->owned, &expected, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            thread_ring = ring;
+            break;
+        }
+    }
+    if (!thread_ring) {
+        Ring *ring = NULL;
+        if (posix_memalign((void **)&ring, LOG_CACHE_LINE, sizeof(Ring)) != 0) {
+            return NULL;
+        }
+        ring->head = 0;
+        ring->tail = 0;
+        ring->dropped = 0;
+        ring->dropped_reported = 0;
+        ring->busy = false;
+        ring->owned = 1;
+        ring->next = __atomic_load_n(&L.rings, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&L.rings, &ring->next, ring, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        }
+        thread_ring = ring;
+    }
+    pthread_setspecific(L.ring_key, thread_ring);
+
+    return thread_ring;
+}
+
+
+// Never blocks: a full ring drops the record and counts it.
+static void log_async(Ring *ring, int level, const char *file, int line, const char *fmt, va_list ap) {
+    if (__atomic_exchange_n(&ring->busy, true, __ATOMIC_ACQUIRE)) {
+        __atomic_add_fetch(&ring->dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    size_t head = ring->head;
+    if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= LOG_RING_RECORDS) {
+        __atomic_add_fetch(&ring->dropped, 1, __ATOMIC_RELAXED);
+    } else {
+        Record *record = &ring->records[head % LOG_RING_RECORDS];
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME_COARSE, &now);
+        record->fmt = fmt;
+        record->file = file;
+        record->time = now.tv_sec;
+        record->line = line;
+        record->level = (uint16_t)level;
+
+        va_list packed;
+        va_copy(packed, ap);
+        if (!pack_args(record, fmt, packed)) {
+            record->fmt = NULL;
+            vsnprintf((char *)record->args, sizeof(record->args), fmt, ap);
+        }
+        va_end(packed);
+        __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+    }
+
+    __atomic_store_n(&ring->busy, false, __ATOMIC_RELEASE);
+}
+
+
+static struct {
+    char batch[LOG_BATCH_SIZE];
+    size_t length;
+    time_t second;
+    struct tm tm;
+    char time[16];
+} F;
+
+
+static void flush_batch(void) {
+    size_t written = 0;
+    while (written < F.length) {
+        ssize_t rc = write(STDERR_FILENO, F.batch + written, F.length - written);
+        if (rc == -1 && errno == EINTR) {
+            continue;
+        }
+        if (rc <= 0) {
+            break;
+        }
+        written += (size_t)rc;
+    }
+    F.length = 0;
+}
+
+
+static void call_callback(Callback *cb, log_event *ev, const char *fmt, ...) {
+    ev->fmt = fmt;
+    ev->data = cb->data;
+    va_start(ev->ap, fmt);
+    cb->fn(ev);
+    va_end(ev->ap);
+}
+
+
+static void write_record(const Record *record) {
+    if (record->time != F.second) {
+        F.second = record->time;
+        localtime_r(&F.second, &F.tm);
+        F.time[strftime(F.time, sizeof(F.time), "%H:%M:%S", &F.tm)] = '\0';
+    }
+
+    char message[LOG_LINE_MAX];
+    format_message(record, message, sizeof(message));
+
+    if (!L.quiet && record->level >= L.level) {
+        if (LOG_BATCH_SIZE - F.length < LOG_LINE_MAX) {
+            flush_batch();
+        }
+        char *line = F.batch + F.length;
+#ifdef LOG_USE_COLOR
+        int length = snprintf(line, LOG_LINE_MAX, "%s %s%-5s\x1b[0m \x1b[90m%s:%d:\x1b[0m %s\n",
+                              F.time, level_colors[record->level], level_strings[record->level],
+                              record->file, record->line, message);
+#else
+        int length = snprintf(line, LOG_LINE_MAX, "%s %-5s %s:%d: %s\n",
+                              F.time, level_strings[record->level], record->file, record->line, message);
+#endif
+        if (length >= LOG_LINE_MAX) {
+            length = LOG_LINE_MAX - 1;
+            line[length - 1] = '\n';
+        }
+        F.length += (size_t)length;
+    }
+
+    for (int i = 0; i < MAX_CALLBACKS && L.callbacks[i].fn; i++) {
+        Callback *cb = &L.callbacks[i];
+        if (record->level >= cb->level) {
+            log_event ev = {
+                    .file  = record->file,
+                    .line  = record->line,
+                    .level = record->level,
+                    .time  = &F.tm,
+            };
+            call_callback(cb, &ev, "%s", message);
+        }
+    }
+}
+
+
+static size_t drain_ring(Ring *ring) {
+    size_t tail = ring->tail;
+    size_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    for (size_t i = tail; i != head; i++) {
+        write_record(&ring->records[i % LOG_RING_RECORDS]);
+    }
+    __atomic_store_n(&ring->tail, head, __ATOMIC_RELEASE);
+
+    unsigned long dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+    if (dropped != ring->dropped_reported) {
+        Record record = {.file = __FILE__, .line = __LINE__, .level = LOG_WARN, .time = time(NULL)};
+        snprintf((char *)record.args, sizeof(record.args), "%lu log messages dropped",
+                 dropped - ring->dropped_reported);
+        ring->dropped_reported = dropped;
+        write_record(&record);
+    }
+
+    return head - tail;
+}
+
+
+static void *flusher_thread(void *arg) {
+    (void)arg;
+    // A signal handler that logs and exits must not run here: exiting would join this very thread.
+    sigset_t signals;
+    sigfillset(&signals);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    struct timespec interval = {.tv_sec = 0, .tv_nsec = LOG_FLUSH_INTERVAL_MS * 1000000L};
+    while (1) {
+        // Read before the pass, so records logged before log_stop_async are always written.
+        bool stopping = __atomic_load_n(&L.stopping, __ATOMIC_ACQUIRE);
+        size_t drained = 0;
+        for (Ring *ring = __atomic_load_n(&L.rings, __ATOMIC_ACQUIRE); ring; ring = ring->next) {
+            drained += drain_ring(ring);
+        }
+        flush_batch();
+        if (stopping) {
+            break;
+        }
+        if (drained == 0) {
+            nanosleep(&interval, NULL);
+        }
+    }
+    return NULL;
+}
+
+
+int log_start_async(void) {
+    if (L.async) {
+        return 0;
+    }
+    int rc;
+    if ((rc = pthread_key_create(&L.ring_key, release_ring)) != 0) {
+        return rc;
+    }
+    F.second = -1;
+    L.stopping = false;
+    if ((rc = pthread_create(&L.flusher, NULL, flusher_thread, NULL)) != 0) {
+        pthread_key_delete(L.ring_key);
+        return rc;
+    }
+    __atomic_store_n(&L.async, true, __ATOMIC_RELEASE);
+    return 0;
+}
+
+
+void log_stop_async(void) {
+    if (!__atomic_exchange_n(&L.async, false, __ATOMIC_ACQ_REL)) {
+        return;
+    }
+    __atomic_store_n(&L.stopping, true, __ATOMIC_RELEASE);
+    pthread_join(L.flusher, NULL);
+}
+
+
 void log_log(int level, const char *file, int line, const char *fmt, ...) {
+    if (__atomic_load_n(&L.async, __ATOMIC_ACQUIRE)) {
+        Ring *ring;
+        if (!is_wanted(level) || (ring = acquire_ring()) == NULL) {
+            return;
+        }
+        va_list ap;
+        va_start(ap, fmt);
+        log_async(ring, level, file, line, fmt, ap);
+        va_end(ap);
+        return;
+    }
+
     log_event ev = {
             .fmt   = fmt,
             .file  = file,
             .line  = line,
             .level = level,
     };
+    struct tm tm;
 
     lock();
 
     if (!L.quiet && level >= L.level) {
-        init_event(&ev, stderr);
+        init_event(&ev, stderr, &tm);
         va_start(ev.ap, fmt);
         stdout_callback(&ev);
         va_end(ev.ap);
@@ -133,7 +621,7 @@ void log_log(int level, const char *file, int line, const char *fmt, ...) {
     for (int i = 0; i < MAX_CALLBACKS && L.callbacks[i].fn; i++) {
         Callback *cb = &L.callbacks[i];
         if (level >= cb->level) {
-            init_event(&ev, cb->data);
+            init_event(&ev, cb->data, &tm);
             va_start(ev.ap, fmt);
             cb->fn(&ev);
             va_end(ev.ap);
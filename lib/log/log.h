@@ -34,6 +34,12 @@ void log_set_level(int level);
 void log_set_quiet(bool enable);
 int log_add_callback(log_log_fn fn, void *data, int level);
 int log_add_fp(FILE *fp, int level);
+// Hands records to per-thread lock-free rings drained by a background thread, which formats and writes them in
+// batches; a record that finds its ring full is dropped and counted. Until started, and after stopping, log_log
+// writes synchronously.
+int log_start_async(void);
+// Writes what is still queued and stops the background thread.
+void log_stop_async(void);
 
 void log_log(int level, const char *file, int line, const char *fmt, ...);
 
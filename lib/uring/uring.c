@@ -0,0 +1,167 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "uring.h"
+#include "log.h"
+
+struct uring {
+    int fd;
+    unsigned flags;
+
+    void *sq_ring;
+    size_t sq_ring_size;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned sqe_tail;      // entries handed out by uring_get_sqe() but not yet published
+
+    void *cq_ring;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+};
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+int uring_create(uring_t *ring, unsigned entries) {
+    uring_t tmp_ring = calloc(1, sizeof(struct uring));
+    if (tmp_ring == NULL) {
+        log_error("uring_create malloc(): %s", strerror(errno));
+        return errno;
+    }
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    if ((tmp_ring->fd = sys_io_uring_setup(entries, &params)) == -1) {
+        int rc = errno;
+        log_warn("io_uring_setup(): %s", strerror(rc));
+        free(tmp_ring);
+        return rc;
+    }
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        log_warn("io_uring: kernel lacks IORING_FEAT_SINGLE_MMAP");
+        close(tmp_ring->fd);
+        free(tmp_ring);
+        return EOPNOTSUPP;
+    }
+    tmp_ring->flags = params.flags;
+
+    // Since IORING_FEAT_SINGLE_MMAP the submission and completion rings share one mapping.
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    tmp_ring->sq_ring_size = sq_size > cq_size ? sq_size : cq_size;
+    tmp_ring->sq_ring = mmap(NULL, tmp_ring->sq_ring_size, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, tmp_ring->fd, IORING_OFF_SQ_RING);
+    if (tmp_ring->sq_ring == MAP_FAILED) {
+        int rc = errno;
+        log_error("io_uring mmap() rings: %s", strerror(rc));
+        close(tmp_ring->fd);
+        free(tmp_ring);
+        return rc;
+    }
+    tmp_ring->cq_ring = tmp_ring->sq_ring;
+
+    tmp_ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    tmp_ring->sqes = mmap(NULL, tmp_ring->sqes_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, tmp_ring->fd, IORING_OFF_SQES);
+    if (tmp_ring->sqes == MAP_FAILED) {
+        int rc = errno;
+        log_error("io_uring mmap() sqes: %s", strerror(rc));
+        munmap(tmp_ring->sq_ring, tmp_ring->sq_ring_size);
+        close(tmp_ring->fd);
+        free(tmp_ring);
+        return rc;
+    }
+
+    char *sq = tmp_ring->sq_ring;
+    tmp_ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+    tmp_ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    tmp_ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    tmp_ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    tmp_ring->sqe_tail = *tmp_ring->sq_tail;
+
+    char *cq = tmp_ring->cq_ring;
+    tmp_ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    tmp_ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    tmp_ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    tmp_ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    *ring = tmp_ring;
+
+    return EXIT_SUCCESS;
+}
+
+struct io_uring_sqe *uring_get_sqe(uring_t ring) {
+    unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if (ring->sqe_tail - head > *ring->sq_mask) {
+        return NULL;
+    }
+
+    unsigned index = ring->sqe_tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    ring->sq_array[index] = index;
+    ring->sqe_tail++;
+    memset(sqe, 0, sizeof(*sqe));
+
+    return sqe;
+}
+
+int uring_submit(uring_t ring, unsigned wait_nr) {
+    unsigned tail = *ring->sq_tail;
+    unsigned to_submit = ring->sqe_tail - tail;
+    __atomic_store_n(ring->sq_tail, ring->sqe_tail, __ATOMIC_RELEASE);
+
+    unsigned flags = wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0;
+    while (sys_io_uring_enter(ring->fd, to_submit, wait_nr, flags) == -1) {
+        if (errno == EINTR) {
+            // Entries are consumed even when the wait is interrupted.
+            to_submit = 0;
+            continue;
+        }
+        if (errno == EBUSY || errno == EAGAIN) {
+            // Completion queue is backed up; the caller has to reap before submitting more.
+            return EXIT_SUCCESS;
+        }
+        log_error("io_uring_enter(): %s", strerror(errno));
+        return errno;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+struct io_uring_cqe *uring_peek_cqe(uring_t ring) {
+    unsigned head = *ring->cq_head;
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+
+    return &ring->cqes[head & *ring->cq_mask];
+}
+
+void uring_cqe_seen(uring_t ring) {
+    __atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+void uring_destroy(uring_t *ring) {
+    if (ring == NULL || *ring == NULL) {
+        return;
+    }
+    munmap((*ring)->sqes, (*ring)->sqes_size);
+    munmap((*ring)->sq_ring, (*ring)->sq_ring_size);
+    close((*ring)->fd);
+    free(*ring);
+    *ring = NULL;
+}
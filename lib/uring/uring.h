@@ -0,0 +1,18 @@
+#ifndef URING_H
+#define URING_H
+
+#include <linux/io_uring.h>
+
+typedef struct uring *uring_t;
+
+int uring_create(uring_t *ring, unsigned entries);
+// Returns a zeroed submission entry or NULL when the submission queue is full.
+struct io_uring_sqe *uring_get_sqe(uring_t ring);
+// Submits queued entries and waits until at least wait_nr completions are available.
+int uring_submit(uring_t ring, unsigned wait_nr);
+// Returns the next completion or NULL; every returned completion must be released with uring_cqe_seen().
+struct io_uring_cqe *uring_peek_cqe(uring_t ring);
+void uring_cqe_seen(uring_t ring);
+void uring_destroy(uring_t *ring);
+
+#endif //URING_H
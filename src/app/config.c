@@ -0,0 +1,212 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include "config.h"
+#include "log.h"
+
+static long online_cpus(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n < 1) {
+        log_warn("sysconf(_SC_NPROCESSORS_ONLN): %s; assume 1 cpu", strerror(errno));
+        return 1;
+    }
+
+    return n;
+}
+
+// CPU time the cgroup may use per period, in whole cpus rounded up, or 0 when it is not limited.
+static long cgroup_cpu_quota(void) {
+    long quota = 0;
+    long period = 0;
+    FILE *file = fopen("/sys/fs/cgroup/cpu.max", "r");
+    if (file != NULL) {
+        // cgroup v2: "<quota|max> <period>"
+        if (fscanf(file, "%ld %ld", &quota, &period) != 2) {
+            quota = 0;
+        }
+        fclose(file);
+    } else if ((file = fopen("/sys/fs/cgroup/cpu/cpu.cfs_quota_us", "r")) != NULL) {
+        // cgroup v1: the quota is -1 when unlimited
+        if (fscanf(file, "%ld", &quota) != 1) {
+            quota = 0;
+        }
+        fclose(file);
+        if ((file = fopen("/sys/fs/cgroup/cpu/cpu.cfs_period_us", "r")) != NULL) {
+            if (fscanf(file, "%ld", &period) != 1) {
+                period = 0;
+            }
+            fclose(file);
+        }
+    }
+    if (quota <= 0 || period <= 0) {
+        return 0;
+    }
+
+    return (quota + period - 1) / period;
+}
+
+// CPUs this process can actually run on: the affinity mask, capped by the cgroup CPU quota.
+static long available_cpus(void) {
+    long n = online_cpus();
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0 && CPU_COUNT(&set) > 0) {
+        n = CPU_COUNT(&set);
+    }
+    long quota = cgroup_cpu_quota();
+    if (quota > 0 && quota < n) {
+        n = quota;
+    }
+
+    return n;
+}
+
+// Connection state is indexed by fd, so the open files limit bounds the table size.
+static long open_files_limit(void) {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0) {
+        log_warn("getrlimit(RLIMIT_NOFILE): %s; assume %d", strerror(errno), DEFAULT_CONN_QUEUE_LEN);
+        return DEFAULT_CONN_QUEUE_LEN;
+    }
+    if (limit.rlim_cur == RLIM_INFINITY || limit.rlim_cur > MAX_CONNECTIONS_LIMIT) {
+        return MAX_CONNECTIONS_LIMIT;
+    }
+
+    return (long)limit.rlim_cur;
+}
+
+static long env_long(const char *name, long default_value, long min, long max) {
+    const char *raw = getenv(name);
+    if (raw == NULL || *raw == '\0') {
+        return default_value;
+    }
+
+    char *end = NULL;
+    errno = 0;
+    long value = strtol(raw, &end, 10);
+    if (errno != 0 || *end != '\0' || value < min || value > max) {
+        log_warn("invalid %s='%s' (expected %ld..%ld); use %ld", name, raw, min, max, default_value);
+        return default_value;
+    }
+
+    return value;
+}
+
+static const char *env_string(const char *name) {
+    const char *raw = getenv(name);
+    if (raw == NULL || *raw == '\0') {
+        return NULL;
+    }
+
+    return raw;
+}
+
+static server_mode_t env_mode(const char *name, server_mode_t default_value) {
+    const char *raw = getenv(name);
+    if (raw == NULL || *raw == '\0') {
+        return default_value;
+    }
+    if (strcmp(raw, "pool") == 0) {
+        return SERVER_MODE_POOL;
+    }
+    if (strcmp(raw, "reactors") == 0) {
+        return SERVER_MODE_REACTORS;
+    }
+
+    log_warn("invalid %s='%s' (expected pool or reactors); use default", name, raw);
+    return default_value;
+}
+
+static server_backend_t env_backend(const char *name, server_backend_t default_value) {
+    const char *raw = getenv(name);
+    if (raw == NULL || *raw == '\0') {
+        return default_value;
+    }
+    if (strcmp(raw, "epoll") == 0) {
+        return SERVER_BACKEND_EPOLL;
+    }
+    if (strcmp(raw, "io_uring") == 0) {
+        return SERVER_BACKEND_IO_URING;
+    }
+
+    log_warn("invalid %s='%s' (expected epoll or io_uring); use default", name, raw);
+    return default_value;
+}
+
+static cpu_affinity_t env_cpu_affinity(const char *name, cpu_affinity_t default_value) {
+    const char *raw = getenv(name);
+    if (raw == NULL || *raw == '\0') {
+        return default_value;
+    }
+    if (strcmp(raw, "off") == 0) {
+        return CPU_AFFINITY_OFF;
+    }
+    if (strcmp(raw, "cpu") == 0) {
+        return CPU_AFFINITY_CPU;
+    }
+    if (strcmp(raw, "node") == 0) {
+        return CPU_AFFINITY_NODE;
+    }
+
+    log_warn("invalid %s='%s' (expected off, cpu or node); use default", name, raw);
+    return default_value;
+}
+
+int config_load(config_t *config) {
+    config->port = (int)env_long("STATIC_SERVER_PORT", DEFAULT_PORT, 1, 65535);
+    config->conn_queue_len = (int)env_long("STATIC_SERVER_CONN_QUEUE_LEN", DEFAULT_CONN_QUEUE_LEN, 1, 65535);
+    config->mode = env_mode("STATIC_SERVER_MODE", SERVER_MODE_POOL);
+    config->backend = env_backend("STATIC_SERVER_BACKEND", SERVER_BACKEND_EPOLL);
+    long cpus = available_cpus();
+    config->reactors = (size_t)env_long("STATIC_SERVER_REACTORS", cpus, 1, 4096);
+    config->cpu_affinity = env_cpu_affinity("STATIC_SERVER_CPU_AFFINITY", CPU_AFFINITY_OFF);
+    config->min_workers = (size_t)env_long("STATIC_SERVER_MIN_WORKERS", cpus, 1, MAX_WORKERS_LIMIT);
+    long max_workers = cpus * DEFAULT_WORKERS_PER_CPU;
+    if (max_workers < (long)config->min_workers) {
+        max_workers = (long)config->min_workers;
+    }
+    if (max_workers > MAX_WORKERS_LIMIT) {
+        max_workers = MAX_WORKERS_LIMIT;
+    }
+    config->max_workers = (size_t)env_long("STATIC_SERVER_MAX_WORKERS", max_workers, (long)config->min_workers,
+                                           MAX_WORKERS_LIMIT);
+    config->spawn_latency_us = (unsigned)env_long("STATIC_SERVER_SPAWN_LATENCY_US", DEFAULT_SPAWN_LATENCY_US,
+                                                  1, 60 * 1000 * 1000);
+    config->worker_idle_timeout_ms = (unsigned)env_long("STATIC_SERVER_WORKER_IDLE_TIMEOUT_MS",
+                                                        DEFAULT_WORKER_IDLE_TIMEOUT_MS, 1, 3600 * 1000);
+    config->queue_depth = (size_t)env_long("STATIC_SERVER_QUEUE_DEPTH", DEFAULT_QUEUE_DEPTH, 1, 1L << 20);
+    config->max_connections = (size_t)env_long("STATIC_SERVER_MAX_CONNECTIONS", open_files_limit(), 1, MAX_CONNECTIONS_LIMIT);
+    config->keep_alive_timeout_ms = (int)env_long("STATIC_SERVER_KEEP_ALIVE_TIMEOUT_MS", DEFAULT_KEEP_ALIVE_TIMEOUT_MS,
+                                                  1, 3600 * 1000);
+    config->keep_alive_requests = (unsigned)env_long("STATIC_SERVER_KEEP_ALIVE_REQUESTS", DEFAULT_KEEP_ALIVE_REQUESTS,
+                                                     1, 1000000);
+    config->error_pages = env_string("STATIC_SERVER_ERROR_PAGES");
+    config->file_cache_size = (size_t)env_long("STATIC_SERVER_FILE_CACHE_SIZE", DEFAULT_FILE_CACHE_SIZE, 0, LONG_MAX);
+    config->file_cache_entries = (size_t)env_long("STATIC_SERVER_FILE_CACHE_ENTRIES", DEFAULT_FILE_CACHE_ENTRIES,
+                                                  1, 1L << 24);
+    config->file_cache_max_file_size = (size_t)env_long("STATIC_SERVER_FILE_CACHE_MAX_FILE_SIZE",
+                                                        DEFAULT_FILE_CACHE_MAX_FILE_SIZE, 0, LONG_MAX);
+    config->open_file_cache_size = (size_t)env_long("STATIC_SERVER_OPEN_FILE_CACHE_SIZE", DEFAULT_OPEN_FILE_CACHE_SIZE,
+                                                    0, 1L << 20);
+    config->compression_level = (int)env_long("STATIC_SERVER_COMPRESSION_LEVEL", DEFAULT_COMPRESSION_LEVEL, 0, 9);
+    config->compression_min_size = (size_t)env_long("STATIC_SERVER_COMPRESSION_MIN_SIZE", DEFAULT_COMPRESSION_MIN_SIZE,
+                                                    0, LONG_MAX);
+    config->compression_cache_size = (size_t)env_long("STATIC_SERVER_COMPRESSION_CACHE_SIZE",
+                                                      DEFAULT_COMPRESSION_CACHE_SIZE, 0, LONG_MAX);
+    config->mime_types = env_string("STATIC_SERVER_MIME_TYPES");
+    if (config->mime_types == NULL) {
+        config->mime_types = DEFAULT_MIME_TYPES_PATH;
+    }
+    config->default_type = env_string("STATIC_SERVER_DEFAULT_TYPE");
+    if (config->default_type == NULL) {
+        config->default_type = DEFAULT_MIME_TYPE;
+    }
+    config->charset = env_string("STATIC_SERVER_CHARSET");
+
+    return EXIT_SUCCESS;
+}
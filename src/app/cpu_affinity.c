@@ -0,0 +1,148 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <sys/socket.h>
+#include "cpu_affinity.h"
+#include "log.h"
+
+static cpu_affinity_t affinity_mode = CPU_AFFINITY_OFF;
+static int *slot_cpus = NULL;
+static int *slot_nodes = NULL;
+static size_t slots_count = 0;
+static size_t cpu_slots[CPU_SETSIZE];
+
+// The cpu directory holds a nodeN link for its NUMA node; -1 without NUMA support.
+static int cpu_node(int cpu) {
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    DIR *dir = opendir(path);
+    if (dir == NULL) {
+        return -1;
+    }
+
+    int node = -1;
+    struct dirent *entry;
+    while (node == -1 && (entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, "node", 4) == 0 && entry->d_name[4] >= '0' && entry->d_name[4] <= '9') {
+            node = atoi(entry->d_name + 4);
+        }
+    }
+    closedir(dir);
+
+    return node;
+}
+
+int cpu_affinity_init(cpu_affinity_t mode) {
+    for (size_t cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        cpu_slots[cpu] = CPU_AFFINITY_NO_SLOT;
+    }
+    if (mode == CPU_AFFINITY_OFF) {
+        return EXIT_SUCCESS;
+    }
+
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+        log_error("sched_getaffinity(): %s", strerror(errno));
+        return errno;
+    }
+
+    size_t count = (size_t)CPU_COUNT(&set);
+    int *tmp_cpus = malloc(count * sizeof(int));
+    int *tmp_nodes = malloc(count * sizeof(int));
+    if (tmp_cpus == NULL || tmp_nodes == NULL) {
+        log_error("cpu_affinity_init malloc(): %s", strerror(errno));
+        free(tmp_cpus);
+        free(tmp_nodes);
+        return ENOMEM;
+    }
+
+    size_t nodes_count = 0;
+    size_t slot = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE && slot < count; cpu++) {
+        if (!CPU_ISSET(cpu, &set)) {
+            continue;
+        }
+        tmp_cpus[slot] = cpu;
+        tmp_nodes[slot] = cpu_node(cpu);
+        if (tmp_nodes[slot] + 1 > (int)nodes_count) {
+            nodes_count = (size_t)tmp_nodes[slot] + 1;
+        }
+        cpu_slots[cpu] = slot++;
+    }
+
+    affinity_mode = mode;
+    slot_cpus = tmp_cpus;
+    slot_nodes = tmp_nodes;
+    slots_count = slot;
+    log_info("cpu affinity: threads pinned to %s over %lu cpus in %lu NUMA node(s)",
+             mode == CPU_AFFINITY_NODE ? "NUMA nodes" : "cpus", slots_count, nodes_count > 0 ? nodes_count : 1);
+
+    return EXIT_SUCCESS;
+}
+
+int cpu_affinity_pin(size_t index) {
+    if (affinity_mode == CPU_AFFINITY_OFF || slots_count == 0) {
+        return EXIT_SUCCESS;
+    }
+
+    size_t slot = index % slots_count;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (affinity_mode == CPU_AFFINITY_NODE && slot_nodes[slot] != -1) {
+        for (size_t i = 0; i < slots_count; i++) {
+            if (slot_nodes[i] == slot_nodes[slot]) {
+                CPU_SET(slot_cpus[i], &set);
+            }
+        }
+    } else {
+        CPU_SET(slot_cpus[slot], &set);
+    }
+
+    int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (rc != 0) {
+        log_warn("pthread_setaffinity_np() cpu %d: %s", slot_cpus[slot], strerror(rc));
+        return rc;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int cpu_affinity_cpu_of(size_t index) {
+    if (affinity_mode == CPU_AFFINITY_OFF || slots_count == 0) {
+        return -1;
+    }
+
+    return slot_cpus[index % slots_count];
+}
+
+size_t cpu_affinity_slots(void) {
+    return affinity_mode == CPU_AFFINITY_OFF ? 0 : slots_count;
+}
+
+size_t cpu_affinity_slot_of_socket(int socket_fd) {
+    if (affinity_mode == CPU_AFFINITY_OFF) {
+        return CPU_AFFINITY_NO_SLOT;
+    }
+
+    int cpu = -1;
+    socklen_t length = sizeof(cpu);
+    if (getsockopt(socket_fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &length) != 0 || cpu < 0 || cpu >= CPU_SETSIZE) {
+        return CPU_AFFINITY_NO_SLOT;
+    }
+
+    return cpu_slots[cpu];
+}
+
+void cpu_affinity_destroy(void) {
+    affinity_mode = CPU_AFFINITY_OFF;
+    free(slot_cpus);
+    free(slot_nodes);
+    slot_cpus = NULL;
+    slot_nodes = NULL;
+    slots_count = 0;
+}
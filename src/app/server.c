@@ -1,93 +1,801 @@
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
+#include <pthread.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <poll.h>
 #include <arpa/inet.h>
+#include <linux/filter.h>
 #include <unistd.h>
 #include "server.h"
+#include "cpu_affinity.h"
+#include "uring.h"
 #include "log.h"
 
+#define EPOLL_MAX_EVENTS 64
+#define CLIENT_EPOLL_EVENTS (EPOLLIN | EPOLLRDHUP | EPOLLET | EPOLLONESHOT)
+#define CLIENT_EPOLL_WRITE_EVENTS (EPOLLOUT | EPOLLET | EPOLLONESHOT)
+#define CLIENT_POLL_EVENTS (POLLIN | POLLRDHUP)
+#define CLIENT_POLL_WRITE_EVENTS POLLOUT
+// How long a peer may take to make room for more of a response.
+#define SEND_TIMEOUT_MS 30000
+
+#define IDLE_SWEEP_INTERVAL_MS 1000
+
+#define URING_ENTRIES 1024
+#define URING_ACCEPT_RETRY_MS 100
+#define URING_USER_DATA(op, fd) (((uint64_t)(op) << 32) | (uint32_t)(fd))
+#define URING_USER_DATA_OP(data) ((data) >> 32)
+#define URING_USER_DATA_FD(data) ((int)(uint32_t)(data))
+
+enum uring_op {
+    URING_OP_ACCEPT = 1,
+    URING_OP_ACCEPT_RETRY,
+    URING_OP_POLL,
+    URING_OP_STOP,
+    URING_OP_WAKE,
+    URING_OP_SWEEP,
+};
+
+// Per-fd bookkeeping of a client socket while it waits in a reactor for its next request, or with writing, for room
+// in its send buffer.
+struct connection {
+    struct reactor *reactor;
+    struct connection *prev;
+    struct connection *next;
+    uint64_t deadline_ms;
+    bool idle;
+    bool writing;
+};
+
+struct reactor {
+    server_t server;
+    size_t id;
+    int socket_fd;
+    int epoll_fd;
+    uring_t ring;
+    struct __kernel_timespec accept_retry;
+    bool accept_multishot;
+    struct __kernel_timespec sweep_interval;
+    pthread_t thread;
+    bool thread_started;
+    pthread_t loop_thread;
+
+    // Idle connections ordered by deadline; every connection gets the same timeout, so appending keeps the order.
+    pthread_mutex_t idle_mutex;
+    struct connection idle;
+
+    // io_uring submissions are single-threaded: other threads queue resumed sockets here and kick wake_fd.
+    int wake_fd;
+    int *resumed;
+    size_t resumed_count;
+};
+
 struct server {
-    int server_socket_fd;
+    struct reactor *reactors;
+    size_t reactors_count;
+    struct connection *connections;
+    size_t max_connections;
+    int stop_event_fd;
+    int port;
+    int conn_queue_len;
+    int idle_timeout_ms;
+    void (*handle_request)(int);
+    bool pin_reactors;
     bool is_running;
 };
 
-int server_create(server_t *server) {
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static int reactor_init(struct reactor *reactor, server_t server, size_t id, server_backend_t backend) {
+    reactor->server = server;
+    reactor->id = id;
+    reactor->epoll_fd = -1;
+    reactor->ring = NULL;
+    reactor->wake_fd = -1;
+    reactor->resumed = NULL;
+    reactor->resumed_count = 0;
+    reactor->thread_started = false;
+    reactor->idle.prev = &reactor->idle;
+    reactor->idle.next = &reactor->idle;
+
+    int rc;
+    if ((rc = pthread_mutex_init(&reactor->idle_mutex, NULL)) != 0) {
+        log_error("reactor pthread_mutex_init(): %s", strerror(rc));
+        return rc;
+    }
+
+    if ((reactor->socket_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) == -1) {
+        log_error("socket(): %s", strerror(errno));
+        pthread_mutex_destroy(&reactor->idle_mutex);
+        return EXIT_FAILURE;
+    }
+
+    // Every reactor binds its own listener to the same port; the kernel spreads connections among them.
+    int opt = 1;
+    if (setsockopt(reactor->socket_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt))) {
+        log_error("setsockopt() SO_REUSEADDR: %s", strerror(errno));
+        goto close_socket;
+    }
+    if (setsockopt(reactor->socket_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt))) {
+        log_error("setsockopt() SO_REUSEPORT: %s", strerror(errno));
+        goto close_socket;
+    }
+
+    if (backend == SERVER_BACKEND_IO_URING) {
+        if (uring_create(&reactor->ring, URING_ENTRIES) == EXIT_SUCCESS) {
+            if ((reactor->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1) {
+                log_error("eventfd(): %s", strerror(errno));
+                goto destroy_ring;
+            }
+            if ((reactor->resumed = malloc(server->max_connections * sizeof(int))) == NULL) {
+                log_error("reactor malloc() resumed: %s", strerror(errno));
+                goto close_wake_fd;
+            }
+            return EXIT_SUCCESS;
+        }
+        log_warn("reactor %lu: io_uring is unavailable; fall back to epoll", id);
+    }
+
+    if ((reactor->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+        log_error("epoll_create1(): %s", strerror(errno));
+        goto close_socket;
+    }
+
+    return EXIT_SUCCESS;
+
+close_wake_fd:
+    close(reactor->wake_fd);
+destroy_ring:
+    uring_destroy(&reactor->ring);
+close_socket:
+    close(reactor->socket_fd);
+    pthread_mutex_destroy(&reactor->idle_mutex);
+    return EXIT_FAILURE;
+}
+
+static void reactor_destroy(struct reactor *reactor) {
+    if (reactor->ring != NULL) {
+        uring_destroy(&reactor->ring);
+        close(reactor->wake_fd);
+        free(reactor->resumed);
+    }
+    if (reactor->epoll_fd != -1) {
+        close(reactor->epoll_fd);
+    }
+    close(reactor->socket_fd);
+    pthread_mutex_destroy(&reactor->idle_mutex);
+    reactor->epoll_fd = -1;
+    reactor->socket_fd = -1;
+}
+
+int server_create(server_t *server, size_t reactors_count, server_backend_t backend, size_t max_connections,
+                  bool pin_reactors) {
     server_t tmp_server = malloc(sizeof(struct server));
     if (tmp_server == NULL) {
         log_error("server_init malloc(): %s", strerror(errno));
         return errno;
     }
+    tmp_server->max_connections = max_connections;
 
-    if ((tmp_server->server_socket_fd = socket(AF_INET, SOCK_STREAM, 0)) == 0) {
-        log_error("socket(): %s", strerror(errno));
-        free(*server);
-        return EXIT_FAILURE;
+    if ((tmp_server->connections = calloc(max_connections, sizeof(struct connection))) == NULL) {
+        log_error("server_init calloc() connections: %s", strerror(errno));
+        free(tmp_server);
+        return errno;
     }
 
-    int opt = IP_PMTUDISC_WANT;
-    if (setsockopt(tmp_server->server_socket_fd, SOL_SOCKET, SO_REUSEADDR | SO_REUSEPORT, &opt, sizeof(opt))) {
-        log_error("setsockopt(): %s", strerror(errno));
+    if ((tmp_server->reactors = malloc(reactors_count * sizeof(struct reactor))) == NULL) {
+        log_error("server_init malloc() reactors: %s", strerror(errno));
+        free(tmp_server->connections);
+        free(tmp_server);
+        return errno;
+    }
+
+    if ((tmp_server->stop_event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1) {
+        log_error("eventfd(): %s", strerror(errno));
+        free(tmp_server->reactors);
+        free(tmp_server->connections);
         free(tmp_server);
         return EXIT_FAILURE;
     }
 
+    for (size_t i = 0; i < reactors_count; i++) {
+        if (reactor_init(&tmp_server->reactors[i], tmp_server, i, backend) != EXIT_SUCCESS) {
+            while (i-- > 0) {
+                reactor_destroy(&tmp_server->reactors[i]);
+            }
+            close(tmp_server->stop_event_fd);
+            free(tmp_server->reactors);
+            free(tmp_server->connections);
+            free(tmp_server);
+            return EXIT_FAILURE;
+        }
+    }
+
+    tmp_server->reactors_count = reactors_count;
+    tmp_server->handle_request = NULL;
+    tmp_server->pin_reactors = pin_reactors;
     tmp_server->is_running = false;
     *server = tmp_server;
 
     return EXIT_SUCCESS;
 }
 
-int server_run(server_t server, int port, int conn_queue_len, void(*handle_request)(int)) {
+static int connection_fd(server_t server, struct connection *connection) {
+    return (int)(connection - server->connections);
+}
+
+// Must be called before the socket is armed, otherwise its wakeup could race with the insertion.
+static void reactor_park(struct reactor *reactor, struct connection *connection) {
+    pthread_mutex_lock(&reactor->idle_mutex);
+    connection->deadline_ms = now_ms() + (connection->writing ? SEND_TIMEOUT_MS : reactor->server->idle_timeout_ms);
+    connection->prev = reactor->idle.prev;
+    connection->next = &reactor->idle;
+    reactor->idle.prev->next = connection;
+    reactor->idle.prev = connection;
+    connection->idle = true;
+    pthread_mutex_unlock(&reactor->idle_mutex);
+}
+
+static void reactor_unpark(struct reactor *reactor, struct connection *connection) {
+    pthread_mutex_lock(&reactor->idle_mutex);
+    if (connection->idle) {
+        connection->prev->next = connection->next;
+        connection->next->prev = connection->prev;
+        connection->prev = connection->next = NULL;
+        connection->idle = false;
+    }
+    pthread_mutex_unlock(&reactor->idle_mutex);
+}
+
+// Expired sockets are only shut down: the wakeup this causes hands them to the request handler, which closes them.
+static void reactor_expire_idle(struct reactor *reactor) {
+    uint64_t now = now_ms();
+    pthread_mutex_lock(&reactor->idle_mutex);
+    while (reactor->idle.next != &reactor->idle && reactor->idle.next->deadline_ms <= now) {
+        struct connection *connection = reactor->idle.next;
+        reactor->idle.next = connection->next;
+        connection->next->prev = &reactor->idle;
+        connection->prev = connection->next = NULL;
+        connection->idle = false;
+
+        int fd = connection_fd(reactor->server, connection);
+        log_debug("connection fd %d is idle for too long; close it", fd);
+        shutdown(fd, SHUT_RDWR);
+    }
+    pthread_mutex_unlock(&reactor->idle_mutex);
+}
+
+static int reactor_watch(struct reactor *reactor, int fd, uint32_t events) {
+    struct epoll_event event = {
+        .events = events,
+        .data.fd = fd,
+    };
+    if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1) {
+        log_error("epoll_ctl() add fd %d: %s", fd, strerror(errno));
+        return errno;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static int reactor_rearm(struct reactor *reactor, int fd, bool writing) {
+    struct epoll_event event = {
+        .events = writing ? CLIENT_EPOLL_WRITE_EVENTS : CLIENT_EPOLL_EVENTS,
+        .data.fd = fd,
+    };
+    if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_MOD, fd, &event) == -1) {
+        log_error("epoll_ctl() mod fd %d: %s", fd, strerror(errno));
+        return errno;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static int reactor_uring_poll(struct reactor *reactor, int fd, enum uring_op op, unsigned events);
+
+// Hands a new client socket to the reactor; the socket is closed on failure.
+static void reactor_add_client(struct reactor *reactor, int fd) {
+    server_t server = reactor->server;
+    if ((size_t)fd >= server->max_connections) {
+        log_warn("fd %d exceeds the connections limit %lu; drop connection", fd, server->max_connections);
+        close(fd);
+        return;
+    }
+
+    // Client sockets are one-shot: the handler owns the socket after the wakeup until it closes or resumes it.
+    struct connection *connection = &server->connections[fd];
+    connection->reactor = reactor;
+    connection->writing = false;
+    reactor_park(reactor, connection);
+
+    int rc = reactor->ring != NULL
+             ? reactor_uring_poll(reactor, fd, URING_OP_POLL, CLIENT_POLL_EVENTS)
+             : reactor_watch(reactor, fd, CLIENT_EPOLL_EVENTS);
+    if (rc != EXIT_SUCCESS) {
+        reactor_unpark(reactor, connection);
+        close(fd);
+    }
+}
+
+static void reactor_dispatch(struct reactor *reactor, int fd) {
+    server_t server = reactor->server;
+    reactor_unpark(reactor, &server->connections[fd]);
+    server->handle_request(fd);
+}
+
+// The listening socket is edge-triggered, so every wakeup must drain the whole backlog.
+static int reactor_accept_all(struct reactor *reactor) {
+    while (1) {
+        int client_socket_fd = accept4(reactor->socket_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_socket_fd == -1) {
+            switch (errno) {
+                case EAGAIN:
+#if EAGAIN != EWOULDBLOCK
+                case EWOULDBLOCK:
+#endif
+                    return EXIT_SUCCESS;
+                case EINTR:
+                case ECONNABORTED:
+                case EPROTO:
+                    continue;
+                case EMFILE:
+                case ENFILE:
+                case ENOBUFS:
+                case ENOMEM:
+                    log_warn("accept4(): %s; pending connections are deferred", strerror(errno));
+                    return EXIT_SUCCESS;
+                default:
+                    log_error("accept4(): %s", strerror(errno));
+                    return errno;
+            }
+        }
+
+        reactor_add_client(reactor, client_socket_fd);
+    }
+}
+
+static int reactor_listen(struct reactor *reactor) {
+    server_t server = reactor->server;
     struct sockaddr_in address;
     address.sin_family = AF_INET;
     address.sin_addr.s_addr = INADDR_ANY;
-    address.sin_port = htons(port);
+    address.sin_port = htons(server->port);
 
-    if (bind(server->server_socket_fd, (struct sockaddr*)&address, sizeof(address)) == -1) {
+    if (bind(reactor->socket_fd, (struct sockaddr*)&address, sizeof(address)) == -1) {
         log_error("bind(): %s", strerror(errno));
         return errno;
     }
 
-    if (listen(server->server_socket_fd, conn_queue_len) == -1) {
+    if (listen(reactor->socket_fd, server->conn_queue_len) == -1) {
         log_error("listen(): %s", strerror(errno));
         return errno;
     }
 
-    log_info("server started on port %d; wait for connections...", port);
+    if (reactor->ring != NULL) {
+        return EXIT_SUCCESS;
+    }
+
+    int rc;
+    if ((rc = reactor_watch(reactor, reactor->socket_fd, EPOLLIN | EPOLLET)) != EXIT_SUCCESS) {
+        return rc;
+    }
+
+    return reactor_watch(reactor, server->stop_event_fd, EPOLLIN);
+}
+
+static struct io_uring_sqe *reactor_uring_sqe(struct reactor *reactor) {
+    struct io_uring_sqe *sqe = uring_get_sqe(reactor->ring);
+    if (sqe == NULL) {
+        // Submission queue is full: flush it to the kernel and retry once.
+        if (uring_submit(reactor->ring, 0) != EXIT_SUCCESS) {
+            return NULL;
+        }
+        sqe = uring_get_sqe(reactor->ring);
+    }
+    if (sqe == NULL) {
+        log_error("reactor %lu: io_uring submission queue is full", reactor->id);
+    }
+
+    return sqe;
+}
+
+// A single multishot accept keeps producing one completion per connection until it is cancelled or fails.
+// Without multishot support each accept completes once and is armed again.
+static int reactor_uring_accept(struct reactor *reactor) {
+    struct io_uring_sqe *sqe = reactor_uring_sqe(reactor);
+    if (sqe == NULL) {
+        return EXIT_FAILURE;
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = reactor->socket_fd;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->ioprio = reactor->accept_multishot ? IORING_ACCEPT_MULTISHOT : 0;
+    sqe->user_data = URING_USER_DATA(URING_OP_ACCEPT, reactor->socket_fd);
+
+    return EXIT_SUCCESS;
+}
+
+static int reactor_uring_timeout(struct reactor *reactor, struct __kernel_timespec *ts, long ms, enum uring_op op) {
+    struct io_uring_sqe *sqe = reactor_uring_sqe(reactor);
+    if (sqe == NULL) {
+        return EXIT_FAILURE;
+    }
+    ts->tv_sec = ms / 1000;
+    ts->tv_nsec = (ms % 1000) * 1000000L;
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->fd = -1;
+    sqe->addr = (uint64_t)(uintptr_t)ts;
+    sqe->len = 1;
+    sqe->user_data = URING_USER_DATA(op, 0);
+
+    return EXIT_SUCCESS;
+}
+
+// One-shot poll, the io_uring counterpart of the client epoll events.
+static int reactor_uring_poll(struct reactor *reactor, int fd, enum uring_op op, unsigned events) {
+    struct io_uring_sqe *sqe = reactor_uring_sqe(reactor);
+    if (sqe == NULL) {
+        return EXIT_FAILURE;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = events;
+    sqe->user_data = URING_USER_DATA(op, fd);
+
+    return EXIT_SUCCESS;
+}
 
-    server->is_running = true;
-    fd_set client_fds;
-    while (server->is_running) {
-        FD_ZERO(&client_fds);
-        FD_SET(server->server_socket_fd, &client_fds);
+static int reactor_uring_handle_accept(struct reactor *reactor, int res, unsigned flags) {
+    if (res >= 0) {
+        reactor_add_client(reactor, res);
+    } else {
+        switch (-res) {
+            case EAGAIN:
+            case EINTR:
+            case ECONNABORTED:
+            case EPROTO:
+                break;
+            case EMFILE:
+            case ENFILE:
+            case ENOBUFS:
+            case ENOMEM:
+                log_warn("io_uring accept: %s; pending connections are deferred", strerror(-res));
+                if (!(flags & IORING_CQE_F_MORE)) {
+                    return reactor_uring_timeout(reactor, &reactor->accept_retry, URING_ACCEPT_RETRY_MS,
+                                                 URING_OP_ACCEPT_RETRY);
+                }
+                break;
+            case EINVAL:
+                if (reactor->accept_multishot) {
+                    log_info("reactor %lu: multishot accept is not supported; accepting one connection at a time",
+                             reactor->id);
+                    reactor->accept_multishot = false;
+                    break;
+                }
+                // fall through
+            default:
+                // Not fatal: the listening socket is still there, so accepting is retried after a pause.
+                log_error("io_uring accept: %s", strerror(-res));
+                if (!(flags & IORING_CQE_F_MORE)) {
+                    return reactor_uring_timeout(reactor, &reactor->accept_retry, URING_ACCEPT_RETRY_MS,
+                                                 URING_OP_ACCEPT_RETRY);
+                }
+                break;
+        }
+    }
 
-        if (select(server->server_socket_fd + 1, &client_fds, NULL, NULL, NULL) == -1) {
-            log_error("select(): %s", strerror(errno));
+    if (!(flags & IORING_CQE_F_MORE)) {
+        return reactor_uring_accept(reactor);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// Kernels before 5.19 reject a multishot accept with EINVAL as soon as it is submitted, so the first completion,
+// if any, tells whether it is supported; without it the reactor falls back to single-shot accepts.
+static int reactor_uring_probe_accept(struct reactor *reactor) {
+    reactor->accept_multishot = true;
+    int rc;
+    if ((rc = reactor_uring_accept(reactor)) != EXIT_SUCCESS) {
+        return rc;
+    }
+    if ((rc = uring_submit(reactor->ring, 0)) != EXIT_SUCCESS) {
+        return rc;
+    }
+
+    struct io_uring_cqe *cqe = uring_peek_cqe(reactor->ring);
+    if (cqe == NULL) {
+        return EXIT_SUCCESS;
+    }
+    int res = cqe->res;
+    unsigned flags = cqe->flags;
+    uring_cqe_seen(reactor->ring);
+
+    return reactor_uring_handle_accept(reactor, res, flags);
+}
+
+static int reactor_uring_handle_wake(struct reactor *reactor) {
+    uint64_t value;
+    if (read(reactor->wake_fd, &value, sizeof(value)) == -1 && errno != EAGAIN) {
+        log_warn("reactor %lu read() wake eventfd: %s", reactor->id, strerror(errno));
+    }
+
+    pthread_mutex_lock(&reactor->idle_mutex);
+    for (size_t i = 0; i < reactor->resumed_count; i++) {
+        int fd = reactor->resumed[i];
+        unsigned events = reactor->server->connections[fd].writing ? CLIENT_POLL_WRITE_EVENTS : CLIENT_POLL_EVENTS;
+        if (reactor_uring_poll(reactor, fd, URING_OP_POLL, events) != EXIT_SUCCESS) {
+            shutdown(fd, SHUT_RDWR);
+        }
+    }
+    reactor->resumed_count = 0;
+    pthread_mutex_unlock(&reactor->idle_mutex);
+
+    return reactor_uring_poll(reactor, reactor->wake_fd, URING_OP_WAKE, POLLIN);
+}
+
+// Accepts and readiness notifications of a whole loop iteration are batched into one io_uring_enter().
+static int reactor_run_uring(struct reactor *reactor) {
+    server_t server = reactor->server;
+    int rc;
+    if ((rc = reactor_uring_probe_accept(reactor)) != EXIT_SUCCESS) {
+        return rc;
+    }
+    if ((rc = reactor_uring_poll(reactor, server->stop_event_fd, URING_OP_STOP, POLLIN)) != EXIT_SUCCESS) {
+        return rc;
+    }
+    if ((rc = reactor_uring_poll(reactor, reactor->wake_fd, URING_OP_WAKE, POLLIN)) != EXIT_SUCCESS) {
+        return rc;
+    }
+    if ((rc = reactor_uring_timeout(reactor, &reactor->sweep_interval, IDLE_SWEEP_INTERVAL_MS,
+                                    URING_OP_SWEEP)) != EXIT_SUCCESS) {
+        return rc;
+    }
+
+    while (__atomic_load_n(&server->is_running, __ATOMIC_ACQUIRE)) {
+        if ((rc = uring_submit(reactor->ring, 1)) != EXIT_SUCCESS) {
+            return rc;
+        }
+
+        struct io_uring_cqe *cqe;
+        while ((cqe = uring_peek_cqe(reactor->ring)) != NULL) {
+            uint64_t data = cqe->user_data;
+            int res = cqe->res;
+            unsigned flags = cqe->flags;
+            uring_cqe_seen(reactor->ring);
+
+            switch (URING_USER_DATA_OP(data)) {
+                case URING_OP_ACCEPT:
+                    rc = reactor_uring_handle_accept(reactor, res, flags);
+                    break;
+                case URING_OP_ACCEPT_RETRY:
+                    rc = reactor_uring_accept(reactor);
+                    break;
+                case URING_OP_POLL:
+                    reactor_dispatch(reactor, URING_USER_DATA_FD(data));
+                    break;
+                case URING_OP_WAKE:
+                    rc = reactor_uring_handle_wake(reactor);
+                    break;
+                case URING_OP_SWEEP:
+                    reactor_expire_idle(reactor);
+                    rc = reactor_uring_timeout(reactor, &reactor->sweep_interval, IDLE_SWEEP_INTERVAL_MS,
+                                               URING_OP_SWEEP);
+                    break;
+                case URING_OP_STOP:
+                default:
+                    break;
+            }
+            if (rc != EXIT_SUCCESS) {
+                return rc;
+            }
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static int reactor_run(struct reactor *reactor) {
+    reactor->loop_thread = pthread_self();
+    if (reactor->ring != NULL) {
+        return reactor_run_uring(reactor);
+    }
+
+    server_t server = reactor->server;
+    struct epoll_event events[EPOLL_MAX_EVENTS];
+    uint64_t next_sweep_ms = now_ms() + IDLE_SWEEP_INTERVAL_MS;
+    int rc;
+    while (__atomic_load_n(&server->is_running, __ATOMIC_ACQUIRE)) {
+        int n = epoll_wait(reactor->epoll_fd, events, EPOLL_MAX_EVENTS, IDLE_SWEEP_INTERVAL_MS);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            log_error("reactor %lu epoll_wait(): %s", reactor->id, strerror(errno));
             return errno;
         }
 
-        int client_socket_fd = -1;
-        if (FD_ISSET(server->server_socket_fd, &client_fds)) {
-            if ((client_socket_fd = accept(server->server_socket_fd, (struct sockaddr*)NULL, NULL)) == -1) {
-                log_error("accept(): %s", strerror(errno));
-                return errno;
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            if (fd == server->stop_event_fd) {
+                continue;
+            }
+            if (fd == reactor->socket_fd) {
+                if ((rc = reactor_accept_all(reactor)) != EXIT_SUCCESS) {
+                    return rc;
+                }
+                continue;
             }
 
-            handle_request(client_socket_fd);
+            reactor_dispatch(reactor, fd);
+        }
+
+        uint64_t now = now_ms();
+        if (now >= next_sweep_ms) {
+            reactor_expire_idle(reactor);
+            next_sweep_ms = now + IDLE_SWEEP_INTERVAL_MS;
         }
     }
 
     return EXIT_SUCCESS;
 }
 
+// Makes the reuseport group hand a connection to the listener of the reactor pinned to the cpu that received it,
+// so the socket is served where its packets and buffers already are. Listeners join the group in reactor order.
+static void server_steer_connections(server_t server) {
+    size_t count = server->reactors_count;
+    size_t length = 2 * count + 3;
+    if (length > BPF_MAXINSNS) {
+        length = 3;
+    }
+    struct sock_filter *code = malloc(length * sizeof(struct sock_filter));
+    if (code == NULL) {
+        log_warn("server_steer_connections malloc(): %s; connections are not steered", strerror(errno));
+        return;
+    }
+
+    size_t n = 0;
+    code[n++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, (uint32_t)(SKF_AD_OFF + SKF_AD_CPU));
+    for (size_t i = 0; length > 3 && i < count; i++) {
+        code[n++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, (uint32_t)cpu_affinity_cpu_of(i), 0, 1);
+        code[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, (uint32_t)i);
+    }
+    // cpus outside the affinity mask
+    code[n++] = (struct sock_filter)BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, (uint32_t)count);
+    code[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_A, 0);
+
+    struct sock_fprog program = {.len = (unsigned short)n, .filter = code};
+    if (setsockopt(server->reactors[0].socket_fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program,
+                   sizeof(program)) != 0) {
+        log_warn("setsockopt() SO_ATTACH_REUSEPORT_CBPF: %s; connections are not steered", strerror(errno));
+    }
+    free(code);
+}
+
+static void *reactor_thread(void *arg) {
+    struct reactor *reactor = arg;
+    if (reactor->server->pin_reactors) {
+        cpu_affinity_pin(reactor->id);
+    }
+    int rc = reactor_run(reactor);
+    if (rc != EXIT_SUCCESS) {
+        log_error("reactor %lu stopped: %s", reactor->id, strerror(rc));
+    }
+
+    return NULL;
+}
+
+int server_run(server_t server, int port, int conn_queue_len, int idle_timeout_ms, void(*handle_request)(int)) {
+    server->port = port;
+    server->conn_queue_len = conn_queue_len;
+    server->idle_timeout_ms = idle_timeout_ms;
+    server->handle_request = handle_request;
+
+    int rc;
+    for (size_t i = 0; i < server->reactors_count; i++) {
+        if ((rc = reactor_listen(&server->reactors[i])) != EXIT_SUCCESS) {
+            return rc;
+        }
+    }
+
+    if (server->pin_reactors && server->reactors_count > 1) {
+        server_steer_connections(server);
+    }
+
+    __atomic_store_n(&server->is_running, true, __ATOMIC_RELEASE);
+
+    // Reactor 0 runs on the calling thread, the others get their own.
+    for (size_t i = 1; i < server->reactors_count; i++) {
+        struct reactor *reactor = &server->reactors[i];
+        if ((rc = pthread_create(&reactor->thread, NULL, reactor_thread, reactor)) != 0) {
+            log_error("pthread_create() reactor %lu: %s", i, strerror(rc));
+            server_stop(server);
+            break;
+        }
+        reactor->thread_started = true;
+    }
+
+    if (__atomic_load_n(&server->is_running, __ATOMIC_ACQUIRE)) {
+        if (server->pin_reactors) {
+            cpu_affinity_pin(0);
+        }
+        log_info("server started on port %d with %lu reactor(s); wait for connections...", port, server->reactors_count);
+        rc = reactor_run(&server->reactors[0]);
+    }
+
+    for (size_t i = 1; i < server->reactors_count; i++) {
+        struct reactor *reactor = &server->reactors[i];
+        if (reactor->thread_started) {
+            pthread_join(reactor->thread, NULL);
+            reactor->thread_started = false;
+        }
+    }
+
+    return rc;
+}
+
+int server_resume(server_t server, int fd, bool writing) {
+    struct connection *connection = &server->connections[fd];
+    struct reactor *reactor = connection->reactor;
+    connection->writing = writing;
+    reactor_park(reactor, connection);
+
+    int rc = EXIT_SUCCESS;
+    if (reactor->ring == NULL) {
+        rc = reactor_rearm(reactor, fd, writing);
+    } else if (pthread_equal(pthread_self(), reactor->loop_thread)) {
+        rc = reactor_uring_poll(reactor, fd, URING_OP_POLL, writing ? CLIENT_POLL_WRITE_EVENTS : CLIENT_POLL_EVENTS);
+    } else {
+        pthread_mutex_lock(&reactor->idle_mutex);
+        reactor->resumed[reactor->resumed_count++] = fd;
+        pthread_mutex_unlock(&reactor->idle_mutex);
+
+        uint64_t one = 1;
+        if (write(reactor->wake_fd, &one, sizeof(one)) != sizeof(one)) {
+            log_warn("server_resume write() to eventfd: %s", strerror(errno));
+        }
+    }
+
+    if (rc != EXIT_SUCCESS) {
+        reactor_unpark(reactor, connection);
+    }
+
+    return rc;
+}
+
+int server_interrupt(server_t server) {
+    if (server == NULL) {
+        return EXIT_SUCCESS;
+    }
+    __atomic_store_n(&server->is_running, false, __ATOMIC_RELEASE);
+    uint64_t one = 1;
+    if (write(server->stop_event_fd, &one, sizeof(one)) != sizeof(one)) {
+        return errno;
+    }
+
+    return EXIT_SUCCESS;
+}
+
 void server_stop(server_t server) {
     if (server == NULL) {
         return;
     }
     log_info("waiting for processing all requests...");
-    server->is_running = false;
+    int rc = server_interrupt(server);
+    if (rc != EXIT_SUCCESS) {
+        log_warn("server_stop write() to eventfd: %s", strerror(rc));
+    }
     log_info("request processing finished");
 }
 
@@ -95,8 +803,12 @@ void server_destroy(server_t *server) {
     if (server == NULL || *server == NULL) {
         return;
     }
-    close((*server)->server_socket_fd);
-    (*server)->server_socket_fd = -1;
+    for (size_t i = 0; i < (*server)->reactors_count; i++) {
+        reactor_destroy(&(*server)->reactors[i]);
+    }
+    close((*server)->stop_event_fd);
+    free((*server)->reactors);
+    free((*server)->connections);
     free(*server);
     *server = NULL;
 }
@@ -1,136 +1,475 @@
 #include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
 #include <string.h>
+#include <limits.h>
+#include <unistd.h>
 #include <pthread.h>
+#include <time.h>
 #include <errno.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
 #include "thread_pool.h"
+#include "cpu_affinity.h"
 #include "log.h"
 
+// A slot's sequence tells whose turn it is: equal to the position when a producer may fill it, position + 1 when
+// a consumer may empty it (Vyukov's bounded MPMC queue). Slots are padded so neighbours do not share a line; the
+// task is stored inline and fits into the same line.
+typedef struct thread_pool_slot {
+    size_t sequence;
+    thread_pool_task_t task;
+} __attribute__((aligned(THREAD_POOL_CACHE_LINE))) thread_pool_slot_t;
+
+typedef struct thread_pool_queue {
+    size_t enqueue_position __attribute__((aligned(THREAD_POOL_CACHE_LINE)));
+    size_t dequeue_position __attribute__((aligned(THREAD_POOL_CACHE_LINE)));
+    size_t mask;
+    thread_pool_slot_t *slots;
+} thread_pool_queue_t;
+
+// Idle threads sleep on a futex word that is bumped by every change they wait for, so a wake-up that races with
+// going to sleep is never lost: the futex refuses to sleep when the word has moved on.
+typedef struct thread_pool_parking {
+    uint32_t sequence;
+    uint32_t waiters;
+} __attribute__((aligned(THREAD_POOL_CACHE_LINE))) thread_pool_parking_t;
+
+typedef enum thread_pool_worker_state {
+    WORKER_UNUSED,
+    WORKER_RUNNING,
+    WORKER_EXITED,     // retired, not joined yet
+} thread_pool_worker_state_t;
+
+typedef struct thread_pool_worker {
+    thread_pool_queue_t queue;
+    uint32_t wake_sequence __attribute__((aligned(THREAD_POOL_CACHE_LINE)));
+    uint32_t parked;
+    uint64_t busy_since_ns;     // start of the task being served, 0 between tasks
+    bool active;        // new tasks may be queued here
+    thread_pool_worker_state_t state;   // guarded by resize_mutex
+    size_t id;
+    pthread_t thread;
+    thread_pool_t pool;
+} __attribute__((aligned(THREAD_POOL_CACHE_LINE))) thread_pool_worker_t;
+
 struct thread_pool {
-    size_t size;
-    size_t capacity;
-    thread_pool_task_t *tasks;
-    pthread_t *threads;
-    pthread_mutex_t queue_mutex;
-    pthread_cond_t queue_cond;
+    thread_pool_worker_t *workers;  // max_workers slots, each with its queue
+    size_t min_workers;
+    size_t max_workers;
+    size_t queue_capacity;
+    uint64_t spawn_latency_ns;
+    struct timespec idle_timeout;
+    void *(*worker_thread)(void *);
+    bool stopping;
+    pthread_mutex_t resize_mutex;
+    uint64_t last_spawn_ns;
+    size_t live_workers;
+    size_t used_slots;      // slots that ever ran a worker; queues past it are always empty
+    size_t next_worker __attribute__((aligned(THREAD_POOL_CACHE_LINE)));    // round-robin start of the load scan
+    uint32_t idle_workers __attribute__((aligned(THREAD_POOL_CACHE_LINE)));
+    thread_pool_parking_t submitters;   // waiting for a free slot
 };
 
-int thread_pool_create(thread_pool_t *pool, size_t capacity) {
-    thread_pool_t tmp_pool = malloc(sizeof(struct thread_pool));
-    if (tmp_pool == NULL) {
-        log_error("thread_pool_init malloc() thread_pool: %s", strerror(errno));
-        return errno;
+static __thread thread_pool_worker_t *current_worker = NULL;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+// Returns ETIMEDOUT once timeout passes, 0 on any other wake-up.
+static int futex_wait(uint32_t *word, uint32_t expected, const struct timespec *timeout) {
+    if (syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, expected, timeout, NULL, 0) == -1 && errno == ETIMEDOUT) {
+        return ETIMEDOUT;
     }
+    return 0;
+}
 
-    tmp_pool->size = 0;
-    tmp_pool->capacity = capacity;
-    if ((tmp_pool->tasks = malloc(capacity * sizeof(thread_pool_task_t))) == NULL) {
-        log_error("thread_pool_init malloc() thread_pool_task: %s", strerror(errno));
-        free(tmp_pool);
-        return errno;
+static void futex_wake(uint32_t *word, int count) {
+    syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+static void parking_notify(thread_pool_parking_t *parking, int count) {
+    __atomic_add_fetch(&parking->sequence, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&parking->waiters, __ATOMIC_SEQ_CST) > 0) {
+        futex_wake(&parking->sequence, count);
     }
-    if ((tmp_pool->threads = malloc(capacity * sizeof(pthread_t))) == NULL) {
-        log_error("thread_pool_init malloc() pthread_t: %s", strerror(errno));
-        free(tmp_pool->tasks);
-        free(tmp_pool);
-        return errno;
+}
+
+static bool queue_push(thread_pool_queue_t *queue, const thread_pool_task_t *task) {
+    size_t position = __atomic_load_n(&queue->enqueue_position, __ATOMIC_RELAXED);
+    while (true) {
+        thread_pool_slot_t *slot = &queue->slots[position & queue->mask];
+        size_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)position;
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&queue->enqueue_position, &position, position + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                slot->task = *task;
+                __atomic_store_n(&slot->sequence, position + 1, __ATOMIC_RELEASE);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            position = __atomic_load_n(&queue->enqueue_position, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static bool queue_pop(thread_pool_queue_t *queue, thread_pool_task_t *task) {
+    size_t position = __atomic_load_n(&queue->dequeue_position, __ATOMIC_RELAXED);
+    while (true) {
+        thread_pool_slot_t *slot = &queue->slots[position & queue->mask];
+        size_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)(position + 1);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&queue->dequeue_position, &position, position + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                *task = slot->task;
+                __atomic_store_n(&slot->sequence, position + queue->mask + 1, __ATOMIC_RELEASE);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            position = __atomic_load_n(&queue->dequeue_position, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+// Approximate: both positions move while they are read.
+static size_t queue_length(thread_pool_queue_t *queue) {
+    size_t dequeue_position = __atomic_load_n(&queue->dequeue_position, __ATOMIC_RELAXED);
+    size_t enqueue_position = __atomic_load_n(&queue->enqueue_position, __ATOMIC_RELAXED);
+    return enqueue_position > dequeue_position ? enqueue_position - dequeue_position : 0;
+}
+
+// Wakes the worker only when it has gone to sleep; a worker on its way there rechecks every queue after announcing
+// itself parked, and the futex refuses to sleep once wake_sequence has moved on.
+static bool wake_worker(thread_pool_worker_t *worker) {
+    if (__atomic_exchange_n(&worker->parked, 0, __ATOMIC_SEQ_CST) == 0) {
+        return false;
+    }
+    __atomic_add_fetch(&worker->wake_sequence, 1, __ATOMIC_SEQ_CST);
+    futex_wake(&worker->wake_sequence, 1);
+    return true;
+}
+
+static thread_pool_worker_t *least_loaded_worker(thread_pool_t pool) {
+    size_t used_slots = __atomic_load_n(&pool->used_slots, __ATOMIC_ACQUIRE);
+    size_t start = __atomic_fetch_add(&pool->next_worker, 1, __ATOMIC_RELAXED);
+    thread_pool_worker_t *best = NULL;
+    size_t best_length = SIZE_MAX;
+    for (size_t i = 0; i < used_slots && best_length > 0; i++) {
+        thread_pool_worker_t *worker = &pool->workers[(start + i) % used_slots];
+        if (!__atomic_load_n(&worker->active, __ATOMIC_ACQUIRE)) {
+            continue;
+        }
+        size_t length = queue_length(&worker->queue);
+        if (length < best_length) {
+            best = worker;
+            best_length = length;
+        }
+    }
+    return best;
+}
+
+static thread_pool_worker_t *push_task(thread_pool_t pool, size_t worker, const thread_pool_task_t *task) {
+    if (worker < pool->max_workers && __atomic_load_n(&pool->workers[worker].active, __ATOMIC_ACQUIRE) &&
+        queue_push(&pool->workers[worker].queue, task)) {
+        return &pool->workers[worker];
+    }
+    thread_pool_worker_t *target = least_loaded_worker(pool);
+    return target != NULL && queue_push(&target->queue, task) ? target : NULL;
+}
+
+// Own queue first, then the others starting with the next worker so thieves spread over victims. Queues of
+// retired workers are scanned as well: a task may have been queued there while its worker was leaving.
+static bool find_task(thread_pool_t pool, thread_pool_worker_t *self, thread_pool_task_t *task) {
+    if (queue_pop(&self->queue, task)) {
+        return true;
+    }
+    size_t used_slots = __atomic_load_n(&pool->used_slots, __ATOMIC_ACQUIRE);
+    for (size_t i = 1; i < used_slots; i++) {
+        if (queue_pop(&pool->workers[(self->id + i) % used_slots].queue, task)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void *worker_main(void *arg) {
+    current_worker = (thread_pool_worker_t *)arg;
+    cpu_affinity_pin(current_worker->id);
+    return current_worker->pool->worker_thread(current_worker->pool);
+}
+
+// Runs a new worker in the lowest free slot. Called with resize_mutex held.
+static int start_worker(thread_pool_t pool) {
+    thread_pool_worker_t *worker = NULL;
+    for (size_t i = 0; i < pool->max_workers && worker == NULL; i++) {
+        if (pool->workers[i].state != WORKER_RUNNING) {
+            worker = &pool->workers[i];
+        }
+    }
+    if (worker == NULL) {
+        return EAGAIN;
     }
 
     int rc;
-    if ((rc = pthread_mutex_init(&tmp_pool->queue_mutex, NULL)) != 0) {
-        log_error("thread_pool_init pthread_mutex_init(): %s", strerror(rc));
-        free(tmp_pool->threads);
-        free(tmp_pool->tasks);
+    if (worker->state == WORKER_EXITED && (rc = pthread_join(worker->thread, NULL)) != 0) {
+        log_error("pthread_join(): %s", strerror(rc));
+        return rc;
+    }
+    worker->state = WORKER_UNUSED;
+    __atomic_store_n(&worker->parked, 0, __ATOMIC_RELAXED);
+    if ((rc = pthread_create(&worker->thread, NULL, worker_main, worker)) != 0) {
+        log_error("pthread_create(): %s", strerror(rc));
+        return rc;
+    }
+    worker->state = WORKER_RUNNING;
+    __atomic_store_n(&worker->active, true, __ATOMIC_RELEASE);
+    __atomic_store_n(&pool->live_workers, pool->live_workers + 1, __ATOMIC_RELAXED);
+    if (worker->id >= pool->used_slots) {
+        __atomic_store_n(&pool->used_slots, worker->id + 1, __ATOMIC_RELEASE);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// Adds a worker when a task is delayed by more than spawn_latency; at most one per spawn_latency, so a single slow
+// burst does not jump straight to max_workers.
+static void spawn_worker(thread_pool_t pool, uint64_t now, uint64_t delay) {
+    if (pthread_mutex_trylock(&pool->resize_mutex) != 0) {
+        return;
+    }
+    if (!pool->stopping && pool->live_workers < pool->max_workers &&
+        now - pool->last_spawn_ns >= pool->spawn_latency_ns && start_worker(pool) == EXIT_SUCCESS) {
+        pool->last_spawn_ns = now;
+        log_info("thread pool: tasks delayed by %lu us, %lu workers now", delay / 1000, pool->live_workers);
+    }
+    pthread_mutex_unlock(&pool->resize_mutex);
+}
+
+// Lets an idle worker exit while the pool is above min_workers. Tasks that reach its queue after the last check
+// are stolen by the others, which scan every used slot.
+static bool retire_worker(thread_pool_t pool, thread_pool_worker_t *self) {
+    bool retired = false;
+    pthread_mutex_lock(&pool->resize_mutex);
+    if (!pool->stopping && pool->live_workers > pool->min_workers) {
+        __atomic_store_n(&self->active, false, __ATOMIC_SEQ_CST);
+        if (queue_length(&self->queue) == 0) {
+            self->state = WORKER_EXITED;
+            __atomic_store_n(&pool->live_workers, pool->live_workers - 1, __ATOMIC_RELAXED);
+            retired = true;
+            log_info("thread pool: worker %lu retired, %lu workers now", self->id, pool->live_workers);
+        } else {
+            __atomic_store_n(&self->active, true, __ATOMIC_SEQ_CST);
+        }
+    }
+    pthread_mutex_unlock(&pool->resize_mutex);
+
+    return retired;
+}
+
+int thread_pool_create(thread_pool_t *pool, size_t min_workers, size_t max_workers, size_t queue_depth,
+                       unsigned spawn_latency_us, unsigned idle_timeout_ms) {
+    thread_pool_t tmp_pool = calloc(1, sizeof(struct thread_pool));
+    if (tmp_pool == NULL) {
+        log_error("thread_pool_create calloc() thread_pool: %s", strerror(errno));
+        return errno;
+    }
+
+    int rc = posix_memalign((void **)&tmp_pool->workers, THREAD_POOL_CACHE_LINE,
+                            max_workers * sizeof(thread_pool_worker_t));
+    if (rc != 0) {
+        log_error("thread_pool_create posix_memalign() workers: %s", strerror(rc));
         free(tmp_pool);
         return rc;
     }
-    if ((rc = pthread_cond_init(&tmp_pool->queue_cond, NULL)) != 0) {
-        log_error("thread_pool_init pthread_cond_init(): %s", strerror(rc));
-        free(tmp_pool->threads);
-        free(tmp_pool->tasks);
+    memset(tmp_pool->workers, 0, max_workers * sizeof(thread_pool_worker_t));
+    tmp_pool->min_workers = min_workers;
+    tmp_pool->max_workers = max_workers;
+    tmp_pool->spawn_latency_ns = (uint64_t)spawn_latency_us * 1000;
+    tmp_pool->idle_timeout.tv_sec = idle_timeout_ms / 1000;
+    tmp_pool->idle_timeout.tv_nsec = (long)(idle_timeout_ms % 1000) * 1000000;
+    if ((rc = pthread_mutex_init(&tmp_pool->resize_mutex, NULL)) != 0) {
+        log_error("thread_pool_create pthread_mutex_init(): %s", strerror(rc));
+        free(tmp_pool->workers);
         free(tmp_pool);
         return rc;
     }
 
+    tmp_pool->queue_capacity = 2;
+    while (tmp_pool->queue_capacity < queue_depth) {
+        tmp_pool->queue_capacity *= 2;
+    }
+    for (size_t i = 0; i < max_workers; i++) {
+        thread_pool_worker_t *worker = &tmp_pool->workers[i];
+        worker->id = i;
+        worker->pool = tmp_pool;
+        worker->queue.mask = tmp_pool->queue_capacity - 1;
+        if ((rc = posix_memalign((void **)&worker->queue.slots, THREAD_POOL_CACHE_LINE,
+                                 tmp_pool->queue_capacity * sizeof(thread_pool_slot_t))) != 0) {
+            log_error("thread_pool_create posix_memalign() slots: %s", strerror(rc));
+            thread_pool_destroy(&tmp_pool);
+            return rc;
+        }
+        for (size_t j = 0; j < tmp_pool->queue_capacity; j++) {
+            worker->queue.slots[j].sequence = j;
+        }
+    }
+
     *pool = tmp_pool;
 
     return EXIT_SUCCESS;
 }
 
 int thread_pool_start(thread_pool_t pool, void *(*worker_thread)(void *)) {
-    for (size_t i = 0; i < pool->capacity; i++) {
-        if (pthread_create(&pool->threads[i], NULL, worker_thread, pool) != 0) {
-            log_error("pthread_create(): %s", strerror(errno));
-            return errno;
-        }
+    pool->worker_thread = worker_thread;
+    pthread_mutex_lock(&pool->resize_mutex);
+    int rc = EXIT_SUCCESS;
+    while (rc == EXIT_SUCCESS && pool->live_workers < pool->min_workers) {
+        rc = start_worker(pool);
+    }
+    pool->last_spawn_ns = now_ns();
+    pthread_mutex_unlock(&pool->resize_mutex);
+    if (rc != EXIT_SUCCESS) {
+        return rc;
     }
+    log_info("thread pool: %lu to %lu workers, queues of %lu", pool->min_workers, pool->max_workers,
+             pool->queue_capacity);
 
     return EXIT_SUCCESS;
 }
 
-int thread_pool_submit(thread_pool_t pool, thread_pool_task_t task) {
-    log_debug("try to put task to pool...");
-    pthread_mutex_lock(&pool->queue_mutex);
+int thread_pool_submit(thread_pool_t pool, size_t worker, thread_pool_task_t task) {
+    task.queued_at_ns = now_ns();
+    thread_pool_worker_t *target;
+    for (unsigned spins = 0; (target = push_task(pool, worker, &task)) == NULL; spins++) {
+        if (__atomic_load_n(&pool->stopping, __ATOMIC_ACQUIRE)) {
+            return THREAD_POOL_STOPPED;
+        }
+        if (spins < THREAD_POOL_SPIN_COUNT) {
+            continue;
+        }
 
-    log_debug("wait for place in pool to put task...");
-    while (pool->size >= pool->capacity) {
-        pthread_cond_wait(&pool->queue_cond, &pool->queue_mutex);
+        thread_pool_parking_t *parking = &pool->submitters;
+        uint32_t sequence = __atomic_load_n(&parking->sequence, __ATOMIC_SEQ_CST);
+        __atomic_add_fetch(&parking->waiters, 1, __ATOMIC_SEQ_CST);
+        target = push_task(pool, worker, &task);
+        if (target == NULL) {
+            futex_wait(&parking->sequence, sequence, NULL);
+        }
+        __atomic_sub_fetch(&parking->waiters, 1, __ATOMIC_SEQ_CST);
+        if (target != NULL) {
+            break;
+        }
     }
 
-    pool->tasks[pool->size++] = task;
-
-    log_debug("task added to pool");
-    pthread_cond_signal(&pool->queue_cond);
-    pthread_mutex_unlock(&pool->queue_mutex);
+    // The owner keeps the task when it is asleep; when it is busy an idle worker is woken to steal it.
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (wake_worker(target)) {
+        return EXIT_SUCCESS;
+    }
+    if (__atomic_load_n(&pool->idle_workers, __ATOMIC_SEQ_CST) > 0) {
+        size_t used_slots = __atomic_load_n(&pool->used_slots, __ATOMIC_ACQUIRE);
+        for (size_t i = 1; i < used_slots; i++) {
+            if (wake_worker(&pool->workers[(target->id + i) % used_slots])) {
+                break;
+            }
+        }
+        return EXIT_SUCCESS;
+    }
 
+    // Nobody is idle: an owner stuck on one task, e.g. a slow disk or client, would hold the new one back.
+    uint64_t busy_since = __atomic_load_n(&target->busy_since_ns, __ATOMIC_RELAXED);
+    if (busy_since != 0 && task.queued_at_ns > busy_since + pool->spawn_latency_ns &&
+        __atomic_load_n(&pool->live_workers, __ATOMIC_RELAXED) < pool->max_workers) {
+        spawn_worker(pool, task.queued_at_ns, task.queued_at_ns - busy_since);
+    }
     return EXIT_SUCCESS;
 }
 
 int thread_pool_take_task(thread_pool_task_t *task, thread_pool_t pool) {
-    log_debug("try to take task from pool...");
-    pthread_mutex_lock(&pool->queue_mutex);
+    thread_pool_worker_t *self = current_worker;
+    __atomic_store_n(&self->busy_since_ns, 0, __ATOMIC_RELAXED);
+    for (unsigned spins = 0; !find_task(pool, self, task); spins++) {
+        if (__atomic_load_n(&pool->stopping, __ATOMIC_ACQUIRE)) {
+            return THREAD_POOL_STOPPED;
+        }
+        if (spins < THREAD_POOL_SPIN_COUNT) {
+            continue;
+        }
 
-    log_debug("wait for any task pool...");
-    while (pool->size == 0) {
-        pthread_cond_wait(&pool->queue_cond, &pool->queue_mutex);
+        uint32_t sequence = __atomic_load_n(&self->wake_sequence, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&self->parked, 1, __ATOMIC_SEQ_CST);
+        __atomic_add_fetch(&pool->idle_workers, 1, __ATOMIC_SEQ_CST);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        bool found = find_task(pool, self, task);
+        int rc = 0;
+        if (!found && !__atomic_load_n(&pool->stopping, __ATOMIC_ACQUIRE)) {
+            rc = futex_wait(&self->wake_sequence, sequence, &pool->idle_timeout);
+        }
+        __atomic_store_n(&self->parked, 0, __ATOMIC_SEQ_CST);
+        __atomic_sub_fetch(&pool->idle_workers, 1, __ATOMIC_SEQ_CST);
+        if (found) {
+            break;
+        }
+        if (rc == ETIMEDOUT && retire_worker(pool, self)) {
+            return THREAD_POOL_RETIRED;
+        }
     }
 
-    thread_pool_task_t t = pool->tasks[--pool->size];
-
-    log_debug("task taken from pool");
-    pthread_cond_signal(&pool->queue_cond);
-    pthread_mutex_unlock(&pool->queue_mutex);
-
-    *task = t;
-
+    uint64_t now = now_ns();
+    __atomic_store_n(&self->busy_since_ns, now, __ATOMIC_RELAXED);
+    uint64_t waited = now > task->queued_at_ns ? now - task->queued_at_ns : 0;
+    if (waited > pool->spawn_latency_ns &&
+        __atomic_load_n(&pool->live_workers, __ATOMIC_RELAXED) < pool->max_workers) {
+        spawn_worker(pool, now, waited);
+    }
+    if (__atomic_load_n(&pool->submitters.waiters, __ATOMIC_SEQ_CST) > 0) {
+        parking_notify(&pool->submitters, 1);
+    }
     return EXIT_SUCCESS;
 }
 
-void thread_pool_cleanup_handler(void *pool) {
-    pthread_mutex_unlock(&((thread_pool_t)pool)->queue_mutex);
+size_t thread_pool_current_worker(void) {
+    return current_worker != NULL ? current_worker->id : THREAD_POOL_ANY_WORKER;
+}
+
+void thread_pool_get_size(thread_pool_t pool, size_t *live_workers, size_t *idle_workers) {
+    *live_workers = __atomic_load_n(&pool->live_workers, __ATOMIC_RELAXED);
+    *idle_workers = __atomic_load_n(&pool->idle_workers, __ATOMIC_RELAXED);
 }
 
 int thread_pool_stop(thread_pool_t pool) {
-    int rc;
     log_info("stop threads in pool...");
-    for (size_t i = 0; i < pool->capacity; i++) {
-        log_debug("send cancellation request to thread %d...", i);
-        if ((rc = pthread_cancel(pool->threads[i])) != 0) {
-            log_error("pthread_cancel(): %s", strerror(rc));
-            return rc;
-        }
+    // Under the mutex, so no worker is spawned or retired from here on.
+    pthread_mutex_lock(&pool->resize_mutex);
+    __atomic_store_n(&pool->stopping, true, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&pool->resize_mutex);
+
+    for (size_t i = 0; i < pool->max_workers; i++) {
+        __atomic_add_fetch(&pool->workers[i].wake_sequence, 1, __ATOMIC_SEQ_CST);
+        futex_wake(&pool->workers[i].wake_sequence, INT_MAX);
     }
-    for (size_t i = 0; i < pool->capacity; i++) {
-        void *thread_rc;
-        log_debug("wait for thread %d...", i);
-        if ((rc = pthread_join(pool->threads[i], &thread_rc)) != 0) {
-            log_error("pthread_join(): %s", strerror(rc));
-            continue; //return rc;
+    parking_notify(&pool->submitters, INT_MAX);
+
+    for (size_t i = 0; i < pool->max_workers; i++) {
+        if (pool->workers[i].state == WORKER_UNUSED) {
+            continue;
         }
-        if (thread_rc != PTHREAD_CANCELED) {
-            log_warn("error: thread %lu exited with code %d", i, thread_rc);
-        } else {
-            log_debug("thread %lu was canceled", i);
+        int rc = pthread_join(pool->workers[i].thread, NULL);
+        if (rc != 0) {
+            log_error("pthread_join(): %s", strerror(rc));
+            continue;
         }
+        pool->workers[i].state = WORKER_UNUSED;
+        log_debug("thread %lu stopped", i);
     }
     log_info("thread pool stopped");
 
@@ -141,15 +480,11 @@ void thread_pool_destroy(thread_pool_t *pool) {
     if (pool == NULL || *pool == NULL) {
         return;
     }
-    int rc;
-    if ((rc = pthread_cond_destroy(&(*pool)->queue_cond)) != 0) {
-        log_error("pthread_cond_destroy(): %s", strerror(rc));
-    }
-    if ((rc = pthread_mutex_destroy(&(*pool)->queue_mutex)) != 0) {
-        log_error("pthread_mutex_destroy(): %s", strerror(rc));
+    for (size_t i = 0; i < (*pool)->max_workers; i++) {
+        free((*pool)->workers[i].queue.slots);
     }
-    free((*pool)->threads);
-    free((*pool)->tasks);
+    pthread_mutex_destroy(&(*pool)->resize_mutex);
+    free((*pool)->workers);
     free(*pool);
     *pool = NULL;
 }
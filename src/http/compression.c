@@ -0,0 +1,343 @@
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <errno.h>
+#include <zlib.h>
+#include "compression.h"
+#include "log.h"
+
+#define ZLIB_WINDOW_BITS 15
+#define ZLIB_GZIP_WINDOW_BITS (ZLIB_WINDOW_BITS + 16)
+#define ZLIB_MEM_LEVEL 8
+
+// A variant stays allocated while it is linked into its shard or referenced by a response being sent.
+struct compressed_variant {
+    struct compressed_variant *hash_next;
+    struct compressed_variant *lru_prev;
+    struct compressed_variant *lru_next;
+    uint64_t hash;
+    char *path;
+    struct timespec mtime;
+    http_compression_t coding;
+    char *data;
+    size_t length;
+    unsigned refs;
+    bool linked;
+};
+
+struct compression_shard {
+    pthread_mutex_t mutex;
+    struct compressed_variant *buckets[COMPRESSION_CACHE_SHARD_BUCKETS];
+    struct compressed_variant lru;      // sentinel: lru_next is the most recently used variant
+    size_t bytes;
+};
+
+struct compression {
+    int level;
+    size_t min_size;
+    size_t shard_max_bytes;
+    struct compression_shard shards[COMPRESSION_CACHE_SHARDS];
+};
+
+static struct compression compression;
+
+// Only (path, coding) is hashed, so a variant made from a newer mtime lands next to the one it replaces.
+static uint64_t hash_key(const char *path, http_compression_t coding) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (const unsigned char *p = (const unsigned char *)path; *p != '\0'; p++) {
+        hash ^= *p;
+        hash *= 1099511628211ULL;
+    }
+    hash ^= (uint64_t)coding;
+    hash *= 1099511628211ULL;
+
+    return hash;
+}
+
+static struct compression_shard *shard_of(uint64_t hash) {
+    return &compression.shards[hash % COMPRESSION_CACHE_SHARDS];
+}
+
+static struct compressed_variant **bucket_of(struct compression_shard *shard, uint64_t hash) {
+    return &shard->buckets[(hash / COMPRESSION_CACHE_SHARDS) % COMPRESSION_CACHE_SHARD_BUCKETS];
+}
+
+static void variant_free(struct compressed_variant *variant) {
+    free(variant->path);
+    free(variant->data);
+    free(variant);
+}
+
+static struct compressed_variant *shard_find(struct compression_shard *shard, uint64_t hash, const char *path,
+                                             http_compression_t coding) {
+    for (struct compressed_variant *variant = *bucket_of(shard, hash); variant != NULL; variant = variant->hash_next) {
+        if (variant->hash == hash && variant->coding == coding && strcmp(variant->path, path) == 0) {
+            return variant;
+        }
+    }
+
+    return NULL;
+}
+
+static void lru_remove(struct compressed_variant *variant) {
+    variant->lru_prev->lru_next = variant->lru_next;
+    variant->lru_next->lru_prev = variant->lru_prev;
+}
+
+static void lru_push_front(struct compression_shard *shard, struct compressed_variant *variant) {
+    variant->lru_prev = &shard->lru;
+    variant->lru_next = shard->lru.lru_next;
+    shard->lru.lru_next->lru_prev = variant;
+    shard->lru.lru_next = variant;
+}
+
+static void shard_link(struct compression_shard *shard, struct compressed_variant *variant) {
+    struct compressed_variant **bucket = bucket_of(shard, variant->hash);
+    variant->hash_next = *bucket;
+    *bucket = variant;
+    lru_push_front(shard, variant);
+    variant->linked = true;
+    shard->bytes += variant->length;
+}
+
+// Must be called with the shard locked; the variant is freed here unless a response still references it.
+static void shard_unlink(struct compression_shard *shard, struct compressed_variant *variant) {
+    struct compressed_variant **link = bucket_of(shard, variant->hash);
+    while (*link != variant) {
+        link = &(*link)->hash_next;
+    }
+    *link = variant->hash_next;
+    lru_remove(variant);
+    variant->linked = false;
+    shard->bytes -= variant->length;
+
+    if (variant->refs == 0) {
+        variant_free(variant);
+    }
+}
+
+static void shard_evict(struct compression_shard *shard) {
+    while (shard->bytes > compression.shard_max_bytes) {
+        shard_unlink(shard, shard->lru.lru_prev);
+    }
+}
+
+int compression_init(int level, size_t min_size, size_t cache_size) {
+    if (level <= 0 || cache_size == 0) {
+        log_info("compression is off");
+        return EXIT_SUCCESS;
+    }
+
+    for (size_t i = 0; i < COMPRESSION_CACHE_SHARDS; i++) {
+        struct compression_shard *shard = &compression.shards[i];
+        int rc = pthread_mutex_init(&shard->mutex, NULL);
+        if (rc != 0) {
+            log_error("compression_init pthread_mutex_init(): %s", strerror(rc));
+            return rc;
+        }
+        shard->lru.lru_next = &shard->lru;
+        shard->lru.lru_prev = &shard->lru;
+    }
+    compression.min_size = min_size;
+    compression.shard_max_bytes = cache_size / COMPRESSION_CACHE_SHARDS > 0 ? cache_size / COMPRESSION_CACHE_SHARDS : 1;
+    compression.level = level > Z_BEST_COMPRESSION ? Z_BEST_COMPRESSION : level;
+    log_info("compression: level %d, files from %lu to %lu bytes, %lu bytes of cache", compression.level,
+             compression.min_size, compression.shard_max_bytes, compression.shard_max_bytes * COMPRESSION_CACHE_SHARDS);
+
+    return EXIT_SUCCESS;
+}
+
+bool compression_accepts(size_t length) {
+    return compression.level > 0 && length >= compression.min_size && length <= compression.shard_max_bytes;
+}
+
+static int compression_lookup(const char *path, struct timespec mtime, http_compression_t coding,
+                              compressed_variant_t *variant) {
+    uint64_t hash = hash_key(path, coding);
+    struct compression_shard *shard = shard_of(hash);
+
+    pthread_mutex_lock(&shard->mutex);
+    struct compressed_variant *found = shard_find(shard, hash, path, coding);
+    if (found != NULL && (found->mtime.tv_sec != mtime.tv_sec || found->mtime.tv_nsec != mtime.tv_nsec)) {
+        found = NULL;
+    }
+    if (found != NULL) {
+        lru_remove(found);
+        lru_push_front(shard, found);
+        found->refs++;
+    }
+    pthread_mutex_unlock(&shard->mutex);
+
+    if (found == NULL) {
+        return ENOENT;
+    }
+    *variant = found;
+
+    return EXIT_SUCCESS;
+}
+
+// Feeds the file to deflate() from memory, or in chunks read at explicit offsets, since the descriptor may be
+// shared with concurrent senders.
+static int compress_file(z_stream *stream, const char *data, int fd, size_t length) {
+    if (data != NULL) {
+        stream->next_in = (Bytef *)data;
+        stream->avail_in = (uInt)length;
+        return deflate(stream, Z_FINISH) == Z_STREAM_END ? EXIT_SUCCESS : EIO;
+    }
+
+    unsigned char *buf = malloc(COMPRESSION_READ_BUFFER_SIZE);
+    if (buf == NULL) {
+        log_error("compress_file malloc(): %s", strerror(errno));
+        return errno;
+    }
+
+    int rc = EXIT_SUCCESS;
+    off_t offset = 0;
+    while ((size_t)offset < length) {
+        size_t chunk = length - (size_t)offset < COMPRESSION_READ_BUFFER_SIZE ? length - (size_t)offset
+                                                                             : COMPRESSION_READ_BUFFER_SIZE;
+        ssize_t n = pread(fd, buf, chunk, offset);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            rc = n == 0 ? EIO : errno;
+            log_error("compress_file pread() from fd %d: %s", fd, strerror(rc));
+            break;
+        }
+        offset += n;
+        stream->next_in = buf;
+        stream->avail_in = (uInt)n;
+        bool last = (size_t)offset == length;
+        int z_rc = deflate(stream, last ? Z_FINISH : Z_NO_FLUSH);
+        if (z_rc == Z_STREAM_ERROR || (last && z_rc != Z_STREAM_END)) {
+            rc = EIO;
+            break;
+        }
+    }
+
+    free(buf);
+    return rc;
+}
+
+static int compress_variant(struct compressed_variant *variant, const char *data, int fd, size_t length) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    int window_bits = variant->coding == HTTP_COMPRESSION_GZIP ? ZLIB_GZIP_WINDOW_BITS : ZLIB_WINDOW_BITS;
+    if (deflateInit2(&stream, compression.level, Z_DEFLATED, window_bits, ZLIB_MEM_LEVEL, Z_DEFAULT_STRATEGY) != Z_OK) {
+        log_error("compress_variant deflateInit2(): %s", stream.msg != NULL ? stream.msg : "failed");
+        return EXIT_FAILURE;
+    }
+
+    // deflateBound() covers the worst case, so a single Z_FINISH always completes.
+    size_t capacity = deflateBound(&stream, (uLong)length);
+    int rc = EXIT_SUCCESS;
+    if ((variant->data = malloc(capacity)) == NULL) {
+        rc = errno;
+        log_error("compress_variant malloc(): %s", strerror(rc));
+        goto exit;
+    }
+    stream.next_out = (Bytef *)variant->data;
+    stream.avail_out = (uInt)capacity;
+    if (length == 0) {
+        rc = deflate(&stream, Z_FINISH) == Z_STREAM_END ? EXIT_SUCCESS : EIO;
+    } else {
+        rc = compress_file(&stream, data, fd, length);
+    }
+    if (rc != EXIT_SUCCESS) {
+        log_error("compress_variant deflate() %s: %s", variant->path, strerror(rc));
+        goto exit;
+    }
+    variant->length = stream.total_out;
+
+    char *shrunk = realloc(variant->data, variant->length > 0 ? variant->length : 1);
+    if (shrunk != NULL) {
+        variant->data = shrunk;
+    }
+
+exit:
+    deflateEnd(&stream);
+    return rc;
+}
+
+int compression_get(const char *path, struct timespec mtime, http_compression_t coding, const char *data, int fd,
+                    size_t length, compressed_variant_t *variant) {
+    if (compression_lookup(path, mtime, coding, variant) == EXIT_SUCCESS) {
+        return EXIT_SUCCESS;
+    }
+
+    struct compressed_variant *tmp = calloc(1, sizeof(struct compressed_variant));
+    if (tmp == NULL) {
+        log_error("compression_get calloc() variant: %s", strerror(errno));
+        return errno;
+    }
+    if ((tmp->path = strdup(path)) == NULL) {
+        log_error("compression_get strdup() %s: %s", path, strerror(errno));
+        variant_free(tmp);
+        return ENOMEM;
+    }
+    tmp->hash = hash_key(path, coding);
+    tmp->mtime = mtime;
+    tmp->coding = coding;
+    tmp->refs = 1;
+
+    int rc = compress_variant(tmp, data, fd, length);
+    if (rc != EXIT_SUCCESS) {
+        variant_free(tmp);
+        return rc;
+    }
+
+    // Concurrent misses compress the same file more than once; the last one replaces the others.
+    struct compression_shard *shard = shard_of(tmp->hash);
+    pthread_mutex_lock(&shard->mutex);
+    struct compressed_variant *old = shard_find(shard, tmp->hash, path, coding);
+    if (old != NULL) {
+        shard_unlink(shard, old);
+    }
+    shard_link(shard, tmp);
+    shard_evict(shard);
+    pthread_mutex_unlock(&shard->mutex);
+    *variant = tmp;
+
+    return EXIT_SUCCESS;
+}
+
+int compressed_variant_get_data(compressed_variant_t variant, const char **data, size_t *length) {
+    *data = variant->data;
+    *length = variant->length;
+    return EXIT_SUCCESS;
+}
+
+void compressed_variant_release(compressed_variant_t *variant) {
+    if (variant == NULL || *variant == NULL) {
+        return;
+    }
+    struct compression_shard *shard = shard_of((*variant)->hash);
+
+    pthread_mutex_lock(&shard->mutex);
+    bool unused = --(*variant)->refs == 0 && !(*variant)->linked;
+    pthread_mutex_unlock(&shard->mutex);
+
+    if (unused) {
+        variant_free(*variant);
+    }
+    *variant = NULL;
+}
+
+void compression_destroy(void) {
+    if (compression.level <= 0) {
+        return;
+    }
+
+    for (size_t i = 0; i < COMPRESSION_CACHE_SHARDS; i++) {
+        struct compression_shard *shard = &compression.shards[i];
+        pthread_mutex_lock(&shard->mutex);
+        while (shard->lru.lru_next != &shard->lru) {
+            shard_unlink(shard, shard->lru.lru_next);
+        }
+        pthread_mutex_unlock(&shard->mutex);
+        pthread_mutex_destroy(&shard->mutex);
+    }
+    compression.level = 0;
+}
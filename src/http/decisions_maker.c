@@ -1,16 +1,23 @@
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <stdatomic.h>
 #include "decisions_maker.h"
+#include "prebuilt_responses.h"
+#include "file_cache.h"
+#include "http_date.h"
+#include "range.h"
+#include "encoding.h"
+#include "compression.h"
+#include "mime_types.h"
 #include "fs.h"
 #include "log.h"
 
-typedef int (*setup_response_template_t)(http_response_t*, http_proto_t);
-
-static int setup_http_response_template(http_response_t *response, http_proto_t proto) {
+static int setup_http_response_template(http_response_t *response, arena_t arena, http_proto_t proto) {
     http_response_t tmp_response = NULL;
-    int rc = http_response_create(&tmp_response);
+    int rc = http_response_create(&tmp_response, arena);
     if (rc != EXIT_SUCCESS) {
         return rc;
     }
@@ -25,9 +32,9 @@ static int setup_http_response_template(http_response_t *response, http_proto_t
     return EXIT_SUCCESS;
 }
 
-static int setup_success_response_template(http_response_t *response, http_proto_t proto) {
+static int setup_success_response_template(http_response_t *response, arena_t arena, http_proto_t proto) {
     http_response_t tmp_response = NULL;
-    int rc = setup_http_response_template(&tmp_response, proto);
+    int rc = setup_http_response_template(&tmp_response, arena, proto);
     if (rc != EXIT_SUCCESS) {
         return rc;
     }
@@ -42,220 +49,552 @@ static int setup_success_response_template(http_response_t *response, http_proto
     return EXIT_SUCCESS;
 }
 
-static int setup_forbidden_response_template(http_response_t *response, http_proto_t proto) {
-    http_response_t tmp_response = NULL;
-    int rc = setup_http_response_template(&tmp_response, proto);
+static int parse_http_request(http_request_t request, char **proto, char **path, http_method_t *method) {
+    int rc = http_request_get_proto(request, proto);
     if (rc != EXIT_SUCCESS) {
         return rc;
     }
-
-    if ((rc = http_response_set_status_code(tmp_response, HTTP_FORBIDDEN)) != EXIT_SUCCESS) {
-        http_response_destroy(&tmp_response);
+    if ((rc = http_request_get_method(request, method)) != EXIT_SUCCESS) {
         return rc;
     }
 
-    *response = tmp_response;
+    return http_request_get_path(request, path);
+}
+
+static int validate_path(const char *path) {
+    if (strstr(path, "/..") != NULL) { // not needed
+        return EXIT_FAILURE;
+    }
+
+    if (strncmp(path, STATIC_PATH, strlen(STATIC_PATH)) != 0) {
+        return EXIT_FAILURE;
+    }
 
     return EXIT_SUCCESS;
 }
 
-static int setup_not_found_response_template(http_response_t *response, http_proto_t proto) {
-    http_response_t tmp_response = NULL;
-    int rc = setup_http_response_template(&tmp_response, proto);
-    if (rc != EXIT_SUCCESS) {
-        return rc;
+typedef struct {
+    arena_t arena;
+    http_status_code_t *status_code;
+    char *path;
+    http_proto_t proto;
+    bool need_body;
+    const char *content_type;
+    size_t content_length;
+    size_t file_size;
+    struct timespec mtime;
+    ino_t inode;
+    const char *range;
+    const char *if_range;
+    const char *if_none_match;
+    const char *if_modified_since;
+    const char *content_encoding;
+    bool vary;
+    bool compress;
+    http_compression_t compression;
+    file_cache_entry_t cached;
+    compressed_variant_t compressed;
+} http_response_data_t;
+
+typedef struct {
+    const char *coding;
+    const char *extension;
+} http_sidecar_t;
+
+// In order of preference when the client weighs the codings equally.
+static const http_sidecar_t sidecars[] = {
+    {"br", ".br"},
+    {"gzip", ".gz"},
+};
+
+#define SIDECARS_COUNT (sizeof(sidecars) / sizeof(sidecars[0]))
+
+// Compares the media type of a Content-Type, ignoring parameters such as charset.
+static bool media_type_is(const char *content_type, const char *media_type) {
+    size_t length = strlen(media_type);
+    return strncmp(content_type, media_type, length) == 0 &&
+           (content_type[length] == '\0' || content_type[length] == ';');
+}
+
+static bool is_compressible(const char *content_type) {
+    return strncmp(content_type, "text/", 5) == 0 || media_type_is(content_type, "image/svg+xml") ||
+           media_type_is(content_type, "application/javascript") || media_type_is(content_type, "application/json") ||
+           media_type_is(content_type, "application/xml") || media_type_is(content_type, "application/wasm") ||
+           media_type_is(content_type, "application/manifest+json");
+}
+
+static void use_cached_entry(http_response_data_t *data) {
+    const char *content = NULL;
+    file_cache_entry_get_data(data->cached, &content, &data->content_length);
+    file_cache_entry_get_mtime(data->cached, &data->mtime);
+    file_cache_entry_get_inode(data->cached, &data->inode);
+    data->file_size = data->content_length;
+}
+
+// A sidecar older than the file it was made from is stale and left alone.
+static bool try_sidecar(http_response_data_t *data, const http_sidecar_t *sidecar) {
+    char *path = arena_sprintf(data->arena, "%s%s", data->path, sidecar->extension);
+    if (path == NULL) {
+        log_error("try_sidecar arena_sprintf(): %s", strerror(errno));
+        return false;
     }
 
-    if ((rc = http_response_set_status_code(tmp_response, HTTP_NOT_FOUND)) != EXIT_SUCCESS) {
-        http_response_destroy(&tmp_response);
-        return rc;
+    file_cache_entry_t cached = NULL;
+    if (file_cache_lookup(path, &cached) == EXIT_SUCCESS) {
+        struct timespec mtime;
+        file_cache_entry_get_mtime(cached, &mtime);
+        if (mtime.tv_sec < data->mtime.tv_sec) {
+            file_cache_release(&cached);
+            return false;
+        }
+        file_cache_release(&data->cached);
+        data->cached = cached;
+        use_cached_entry(data);
+    } else {
+        file_info_t info;
+        if (get_file_info(path, &info) != REGULAR || info.mtime.tv_sec < data->mtime.tv_sec) {
+            return false;
+        }
+        file_cache_release(&data->cached);
+        data->content_length = info.size;
+        data->file_size = info.size;
+        data->mtime = info.mtime;
+        data->inode = info.inode;
     }
+    data->path = path;
+    data->content_encoding = sidecar->coding;
 
-    *response = tmp_response;
+    return true;
+}
 
-    return EXIT_SUCCESS;
+// Switches to the precompressed sidecar the client weighs highest, unless it prefers the file as is.
+static void select_sidecar(http_response_data_t *data, const char *accept_encoding) {
+    unsigned identity = http_accept_encoding_identity_rank(accept_encoding);
+    unsigned weights[SIDECARS_COUNT];
+    for (size_t i = 0; i < SIDECARS_COUNT; i++) {
+        weights[i] = http_accept_encoding_weight(accept_encoding, sidecars[i].coding);
+    }
+
+    for (size_t round = 0; round < SIDECARS_COUNT; round++) {
+        size_t best = SIDECARS_COUNT;
+        for (size_t i = 0; i < SIDECARS_COUNT; i++) {
+            if (weights[i] > 0 && weights[i] >= identity && (best == SIDECARS_COUNT || weights[i] > weights[best])) {
+                best = i;
+            }
+        }
+        if (best == SIDECARS_COUNT || try_sidecar(data, &sidecars[best])) {
+            return;
+        }
+        weights[best] = 0;
+    }
 }
 
-static int setup_not_allowed_response_template(http_response_t *response, http_proto_t proto) {
-    http_response_t tmp_response = NULL;
-    int rc = setup_http_response_template(&tmp_response, proto);
+// Picks gzip or deflate for a file without a usable sidecar; gzip wins a tie.
+static void select_compression(http_response_data_t *data, const char *accept_encoding) {
+    if (!compression_accepts(data->content_length)) {
+        return;
+    }
+
+    unsigned identity = http_accept_encoding_identity_rank(accept_encoding);
+    unsigned gzip = http_accept_encoding_weight(accept_encoding, "gzip");
+    unsigned deflate = http_accept_encoding_weight(accept_encoding, "deflate");
+    if (gzip > 0 && gzip >= deflate && gzip >= identity) {
+        data->compression = HTTP_COMPRESSION_GZIP;
+        data->content_encoding = "gzip";
+    } else if (deflate > 0 && deflate >= identity) {
+        data->compression = HTTP_COMPRESSION_DEFLATE;
+        data->content_encoding = "deflate";
+    } else {
+        return;
+    }
+    data->compress = true;
+}
+
+// Swaps the body for its compressed variant, which is made once per file version and then served from memory.
+// The file goes out uncompressed if that fails.
+static void use_compressed_variant(http_response_data_t *data) {
+    const char *content = NULL;
+    int fd = -1;
+    bool opened = false;
+    if (data->cached != NULL) {
+        size_t length = 0;
+        file_cache_entry_get_data(data->cached, &content, &length);
+        file_cache_entry_get_fd(data->cached, &fd);
+    } else {
+        if ((fd = open(data->path, O_RDONLY | O_CLOEXEC)) == -1) {
+            log_error("use_compressed_variant open() %s: %s", data->path, strerror(errno));
+            goto identity;
+        }
+        opened = true;
+    }
+
+    int rc = compression_get(data->path, data->mtime, data->compression, content, fd, data->content_length,
+                             &data->compressed);
+    if (opened) {
+        close(fd);
+    }
     if (rc != EXIT_SUCCESS) {
-        return rc;
+        goto identity;
     }
+    file_cache_release(&data->cached);
+    compressed_variant_get_data(data->compressed, &content, &data->content_length);
+    return;
 
-    if ((rc = http_response_set_status_code(tmp_response, HTTP_METHOD_NOT_ALLOWED)) != EXIT_SUCCESS) {
-        http_response_destroy(&tmp_response);
-        return rc;
+identity:
+    data->compress = false;
+    data->content_encoding = NULL;
+}
+
+// Error responses were serialized at startup; only the response object pointing at one is allocated here.
+static int make_error_response(http_response_data_t data, http_response_t *response) {
+    const http_prebuilt_response_t *prebuilt = http_prebuilt_response_find(*data.status_code);
+    if (prebuilt == NULL) {
+        log_error("no prebuilt response for %s", *data.status_code);
+        *data.status_code = HTTP_INTERNAL_SERVER_ERROR;
+        if ((prebuilt = http_prebuilt_response_find(*data.status_code)) == NULL) {
+            return EXIT_FAILURE;
+        }
     }
 
-    *response = tmp_response;
+    return http_response_create_prebuilt(response, data.arena, prebuilt, data.need_body);
+}
 
-    return EXIT_SUCCESS;
+#define ETAG_SIZE 96
+
+// The tag is derived from the stat data alone, so it is the same whether the file is served from memory, from a
+// cached descriptor or from disk. A file changed within the current second may change again without a visible
+// mtime step on coarse filesystems, so its tag is only weak.
+static void format_etag(http_response_data_t data, char *buf, size_t size) {
+    snprintf(buf, size, "%s\"%lx-%lx%08lx-%lx%s%s\"", data.mtime.tv_sec >= time(NULL) ? "W/" : "",
+             (unsigned long)data.inode, (unsigned long)data.mtime.tv_sec, (unsigned long)data.mtime.tv_nsec,
+             (unsigned long)data.file_size, data.compress ? "-" : "", data.compress ? data.content_encoding : "");
 }
 
-static int setup_fail_response_template(http_response_t *response, http_proto_t proto) {
-    http_response_t tmp_response = NULL;
-    int rc = setup_http_response_template(&tmp_response, proto);
+static int set_validators(http_response_data_t data, http_response_t response) {
+    char etag[ETAG_SIZE] = {'\0'};
+    format_etag(data, etag, sizeof(etag));
+    int rc = http_response_set_header(response, "ETag", etag);
     if (rc != EXIT_SUCCESS) {
         return rc;
     }
 
-    if ((rc = http_response_set_status_code(tmp_response, HTTP_INTERNAL_SERVER_ERROR)) != EXIT_SUCCESS) {
-        http_response_destroy(&tmp_response);
-        return rc;
+    char last_modified[HTTP_DATE_SIZE] = {'\0'};
+    if (http_date_format(data.mtime.tv_sec, last_modified, sizeof(last_modified)) != EXIT_SUCCESS) {
+        return EXIT_SUCCESS;
     }
 
-    *response = tmp_response;
+    return http_response_set_header(response, "Last-Modified", last_modified);
+}
 
-    return EXIT_SUCCESS;
+// Compares an If-None-Match list against etag with the weak comparison GET and HEAD use.
+static bool etag_list_matches(const char *list, const char *etag) {
+    if (strncmp(etag, "W/", 2) == 0) {
+        etag += 2;
+    }
+    size_t etag_len = strlen(etag);
+
+    const char *p = list;
+    while (*p != '\0') {
+        while (*p == ' ' || *p == '\t' || *p == ',') {
+            p++;
+        }
+        if (*p == '*') {
+            return true;
+        }
+        if (strncmp(p, "W/", 2) == 0) {
+            p += 2;
+        }
+        const char *end = p;
+        if (*end == '"') {
+            end = strchr(end + 1, '"');
+            end = end != NULL ? end + 1 : p + strlen(p);
+        }
+        while (*end != '\0' && *end != ',') {
+            end++;
+        }
+        size_t len = (size_t)(end - p);
+        while (len > 0 && (p[len - 1] == ' ' || p[len - 1] == '\t')) {
+            len--;
+        }
+        if (len == etag_len && strncmp(p, etag, len) == 0) {
+            return true;
+        }
+        p = end;
+    }
+
+    return false;
 }
 
-static int setup_not_implemented_response_template(http_response_t *response, http_proto_t proto) {
-    http_response_t tmp_response = NULL;
-    int rc = setup_http_response_template(&tmp_response, proto);
-    if (rc != EXIT_SUCCESS) {
-        return rc;
+// RFC 9110 13.2.2: If-None-Match wins over If-Modified-Since, which is only a fallback for clients without tags.
+static bool is_not_modified(http_response_data_t data) {
+    if (data.if_none_match != NULL) {
+        char etag[ETAG_SIZE] = {'\0'};
+        format_etag(data, etag, sizeof(etag));
+        return etag_list_matches(data.if_none_match, etag);
+    }
+    if (data.if_modified_since != NULL) {
+        time_t date = 0;
+        return http_date_parse(data.if_modified_since, &date) == EXIT_SUCCESS && data.mtime.tv_sec <= date;
     }
 
-    if ((rc = http_response_set_status_code(tmp_response, HTTP_NOT_IMPLEMENTED)) != EXIT_SUCCESS) {
-        http_response_destroy(&tmp_response);
-        return rc;
+    return false;
+}
+
+// If-Range needs a strong match: the same strong entity tag, or the exact Last-Modified second.
+static bool if_range_matches(http_response_data_t data) {
+    if (data.if_range == NULL) {
+        return true;
+    }
+    if (strncmp(data.if_range, "W/", 2) == 0) {
+        return false;
+    }
+    if (data.if_range[0] == '"') {
+        char etag[ETAG_SIZE] = {'\0'};
+        format_etag(data, etag, sizeof(etag));
+        return strcmp(data.if_range, etag) == 0;
     }
 
-    *response = tmp_response;
+    time_t date = 0;
+    if (http_date_parse(data.if_range, &date) != EXIT_SUCCESS) {
+        return false;
+    }
 
-    return EXIT_SUCCESS;
+    return date == data.mtime.tv_sec;
 }
 
-static int parse_http_request(http_request_t request, char **proto, char **path, http_method_t *method) {
-    int rc = http_request_get_proto(request, proto);
+// A 304 carries the validators but no body, so the file is neither opened nor read.
+static int make_not_modified_response(http_response_data_t data, http_response_t *response) {
+    file_cache_release(&data.cached);
+
+    int rc = setup_http_response_template(response, data.arena, data.proto);
     if (rc != EXIT_SUCCESS) {
         return rc;
     }
-    if ((rc = http_request_get_method(request, method)) != EXIT_SUCCESS) {
-        return rc;
+    if (http_response_set_status_code(*response, HTTP_NOT_MODIFIED) != EXIT_SUCCESS) {
+        goto fail;
+    }
+    if (set_validators(data, *response) != EXIT_SUCCESS) {
+        goto fail;
+    }
+    if (data.vary && http_response_set_header(*response, "Vary", "Accept-Encoding") != EXIT_SUCCESS) {
+        goto fail;
     }
 
-    return http_request_get_path(request, path);
+    return EXIT_SUCCESS;
+
+fail:
+    http_response_destroy(response);
+    *data.status_code = HTTP_INTERNAL_SERVER_ERROR;
+    return make_error_response(data, response);
 }
 
-static int validate_path(const char *path) {
-    if (strstr(path, "/..") != NULL) { // not needed
-        return EXIT_FAILURE;
-    }
+static int make_unsatisfiable_response(http_response_data_t data, http_response_t *response) {
+    file_cache_release(&data.cached);
+    compressed_variant_release(&data.compressed);
+    *data.status_code = HTTP_RANGE_NOT_SATISFIABLE;
 
-    if (strncmp(path, STATIC_PATH, strlen(STATIC_PATH)) != 0) {
-        return EXIT_FAILURE;
+    int rc = setup_http_response_template(response, data.arena, data.proto);
+    if (rc != EXIT_SUCCESS) {
+        return rc;
+    }
+    if (http_response_set_status_code(*response, HTTP_RANGE_NOT_SATISFIABLE) != EXIT_SUCCESS) {
+        goto fail;
+    }
+    char buf[48] = {'\0'};
+    snprintf(buf, sizeof(buf), "bytes */%lu", data.content_length);
+    if (http_response_set_header(*response, "Content-Range", buf) != EXIT_SUCCESS) {
+        goto fail;
+    }
+    if (http_response_set_header(*response, "Content-Length", "0") != EXIT_SUCCESS) {
+        goto fail;
     }
 
     return EXIT_SUCCESS;
+
+fail:
+    http_response_destroy(response);
+    *data.status_code = HTTP_INTERNAL_SERVER_ERROR;
+    return make_error_response(data, response);
 }
 
-static int detect_content_type(const char *path, char **content_type) {
-    size_t len = strlen(path);
-    if (len >= 5 && strcmp(path + len - 5, ".html") == 0) {
-        *content_type = "text/html";
-        return EXIT_SUCCESS;
-    } else if (len >= 4 && strcmp(path + len - 4, ".css") == 0) {
-        *content_type = "text/css";
-        return EXIT_SUCCESS;
-    } else if (len >= 3 && strcmp(path + len - 3, ".js") == 0) {
-        *content_type = "text/javascript";
-        return EXIT_SUCCESS;
-    } else if (len >= 4 && strcmp(path + len - 4, ".png") == 0) {
-        *content_type = "image/png";
-        return EXIT_SUCCESS;
-    } else if (len >= 4 && strcmp(path + len - 4, ".jpg") == 0) {
-        *content_type = "image/jpg";
-        return EXIT_SUCCESS;
-    } else if (len >= 5 && strcmp(path + len - 5, ".jpeg") == 0) {
-        *content_type = "image/jpe";
-        return EXIT_SUCCESS;
-    } else if (len >= 4 && strcmp(path + len - 4, ".gif") == 0) {
-        *content_type = "image/gif";
-        return EXIT_SUCCESS;
-    } else if (len >= 4 && strcmp(path + len - 4, ".svg") == 0) {
-        *content_type = "image/svg";
-        return EXIT_SUCCESS;
-    } else if (len >= 4 && (strcmp(path + len - 4, ".swf") == 0 || strcmp(path + len - 4, ".mp4") == 0)) {
-        *content_type = "application/x-shockwave-flash";
-        return EXIT_SUCCESS;
+static int select_single_range(http_response_data_t data, http_response_t response, http_range_t range,
+                               size_t *content_length) {
+    char buf[72] = {'\0'};
+    snprintf(buf, sizeof(buf), "bytes %lld-%lld/%lu", (long long)range.offset,
+             (long long)range.offset + (long long)range.length - 1, data.content_length);
+    int rc = http_response_set_header(response, "Content-Range", buf);
+    if (rc != EXIT_SUCCESS) {
+        return rc;
     }
+    *content_length = range.length;
 
-    return EXIT_FAILURE;
+    return http_response_select_range(response, range.offset, range.length);
 }
 
-static setup_response_template_t select_response_setup_func(http_status_code_t status_code) {
-    return status_code == HTTP_OK ?                     setup_success_response_template     : \
-           status_code == HTTP_FORBIDDEN ?              setup_forbidden_response_template   : \
-           status_code == HTTP_NOT_FOUND ?              setup_not_found_response_template   : \
-           status_code == HTTP_METHOD_NOT_ALLOWED ?     setup_not_allowed_response_template : \
-           status_code == HTTP_INTERNAL_SERVER_ERROR ?  setup_fail_response_template        : \
-                                                        setup_not_implemented_response_template;
-}
+// Every part head is formatted up front, so Content-Length is known before anything is sent.
+static int select_multiple_ranges(http_response_data_t data, http_response_t response, const http_range_t *ranges,
+                                  size_t count, size_t *content_length) {
+    static atomic_ulong boundary_counter = 0;
+    char boundary[40] = {'\0'};
+    snprintf(boundary, sizeof(boundary), "%08lx%012lx", (unsigned long)time(NULL),
+             atomic_fetch_add(&boundary_counter, 1));
+
+    http_body_part_t *parts = arena_alloc(data.arena, count * sizeof(http_body_part_t));
+    if (parts == NULL) {
+        log_error("select_multiple_ranges arena_alloc() parts: %s", strerror(errno));
+        return errno;
+    }
 
-typedef struct {
-    http_status_code_t *status_code;
-    char *path;
-    http_proto_t proto;
-    bool need_body;
-    char *content_type;
-    size_t content_length;
-    bool already_handled;
-} http_response_data_t;
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        char *head = arena_sprintf(data.arena, "\r\n--%s\r\nContent-Type: %s\r\nContent-Range: bytes %lld-%lld/%lu\r\n\r\n",
+                                   boundary, data.content_type, (long long)ranges[i].offset,
+                                   (long long)ranges[i].offset + (long long)ranges[i].length - 1,
+                                   data.content_length);
+        if (head == NULL) {
+            log_error("select_multiple_ranges arena_sprintf() part head: %s", strerror(errno));
+            return errno;
+        }
+        parts[i].head = head;
+        parts[i].head_length = strlen(head);
+        parts[i].offset = ranges[i].offset;
+        parts[i].length = ranges[i].length;
+        total += parts[i].head_length + parts[i].length;
+    }
 
-static int make_response(http_response_data_t data, http_response_t *response) {
-    if (data.already_handled) {
-        http_response_destroy(response);
+    char *trailer = arena_sprintf(data.arena, "\r\n--%s--\r\n", boundary);
+    char *content_type = arena_sprintf(data.arena, "multipart/byteranges; boundary=%s", boundary);
+    if (trailer == NULL || content_type == NULL) {
+        log_error("select_multiple_ranges arena_sprintf(): %s", strerror(errno));
+        return errno;
+    }
+    total += strlen(trailer);
+
+    int rc = http_response_set_header(response, "Content-Type", content_type);
+    if (rc != EXIT_SUCCESS) {
+        return rc;
+    }
+    *content_length = total;
+
+    return http_response_select_parts(response, parts, count, trailer);
+}
+
+static int make_success_response(http_response_data_t data, http_response_t *response) {
+    http_range_t ranges[HTTP_MAX_RANGES];
+    size_t ranges_count = 0;
+    int range_rc = HTTP_RANGE_IGNORED;
+    if (data.need_body && data.range != NULL && if_range_matches(data)) {
+        range_rc = http_range_parse(data.range, data.content_length, ranges, HTTP_MAX_RANGES, &ranges_count);
+    }
+    if (range_rc == HTTP_RANGE_UNSATISFIABLE) {
+        return make_unsatisfiable_response(data, response);
     }
 
-    setup_response_template_t setup_response_template = select_response_setup_func(*data.status_code);
-    int rc = setup_response_template(response, data.proto);
+    int rc = setup_success_response_template(response, data.arena, data.proto);
     if (rc != EXIT_SUCCESS) {
         return rc;
     }
 
-    if (!data.already_handled && *data.status_code == HTTP_OK) {
+    if (range_rc != EXIT_SUCCESS || ranges_count == 1) {
         if (http_response_set_header(*response, "Content-Type", data.content_type) != EXIT_SUCCESS) {
-            *data.status_code = HTTP_INTERNAL_SERVER_ERROR;
-            data.already_handled = true;
-            return make_response(data, response);
+            goto fail;
         }
-        char buf[20] = {'\0'};
-        snprintf(buf, 20, "%lu", data.content_length);
-        if (http_response_set_header(*response, "Content-Length", buf) != EXIT_SUCCESS) {
-            *data.status_code = HTTP_INTERNAL_SERVER_ERROR;
-            data.already_handled = true;
-            return make_response(data, response);
+    }
+    if (http_response_set_header(*response, "Accept-Ranges", "bytes") != EXIT_SUCCESS) {
+        goto fail;
+    }
+    if (set_validators(data, *response) != EXIT_SUCCESS) {
+        goto fail;
+    }
+    if (data.content_encoding != NULL &&
+        http_response_set_header(*response, "Content-Encoding", data.content_encoding) != EXIT_SUCCESS) {
+        goto fail;
+    }
+    if (data.vary && http_response_set_header(*response, "Vary", "Accept-Encoding") != EXIT_SUCCESS) {
+        goto fail;
+    }
+
+    if (data.compressed != NULL) {
+        if (!data.need_body) {
+            compressed_variant_release(&data.compressed);
+        } else if (http_response_set_compressed_body(*response, data.compressed) != EXIT_SUCCESS) {
+            goto fail;
+        }
+    } else if (data.cached != NULL) {
+        if (!data.need_body) {
+            file_cache_release(&data.cached);
+        } else if (http_response_set_cached_body(*response, data.cached) != EXIT_SUCCESS) {
+            goto fail;
+        }
+    } else if (data.need_body) {
+        int fd = open(data.path, O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            log_error("make_decision(): %s", strerror(errno));
+            goto fail;
         }
+        if (http_response_set_attachment(*response, fd, data.content_length) != EXIT_SUCCESS) {
+            close(fd);
+            goto fail;
+        }
+    }
 
-        if (data.need_body) {
-            int fd = open(data.path, O_RDONLY);
-            if (fd == -1) {
-                log_error("make_decision(): %s", strerror(errno));
-                *data.status_code = HTTP_INTERNAL_SERVER_ERROR;
-                data.already_handled = true;
-                return make_response(data, response);
-            }
-            if (http_response_set_attachment(*response, fd) != EXIT_SUCCESS) {
-                *data.status_code = HTTP_INTERNAL_SERVER_ERROR;
-                data.already_handled = true;
-                return make_response(data, response);
-            }
+    size_t content_length = data.content_length;
+    if (range_rc == EXIT_SUCCESS) {
+        if (http_response_set_status_code(*response, HTTP_PARTIAL_CONTENT) != EXIT_SUCCESS) {
+            goto fail_body;
+        }
+        *data.status_code = HTTP_PARTIAL_CONTENT;
+        if (ranges_count == 1) {
+            rc = select_single_range(data, *response, ranges[0], &content_length);
+        } else {
+            rc = select_multiple_ranges(data, *response, ranges, ranges_count, &content_length);
+        }
+        if (rc != EXIT_SUCCESS) {
+            goto fail_body;
         }
     }
 
+    char buf[20] = {'\0'};
+    snprintf(buf, 20, "%lu", content_length);
+    if (http_response_set_header(*response, "Content-Length", buf) != EXIT_SUCCESS) {
+        goto fail_body;
+    }
+
     return EXIT_SUCCESS;
+
+fail_body:
+    // The response owns the body by now, cached or opened.
+    data.cached = NULL;
+    data.compressed = NULL;
+    http_response_close_attachment(*response);
+fail:
+    file_cache_release(&data.cached);
+    compressed_variant_release(&data.compressed);
+    http_response_destroy(response);
+    *data.status_code = HTTP_INTERNAL_SERVER_ERROR;
+    return make_error_response(data, response);
 }
 
-int make_decision(http_request_t request, http_response_t *response, http_status_code_t *status_code) {
+static int make_response(http_response_data_t data, http_response_t *response) {
+    if (strcmp(*data.status_code, HTTP_NOT_MODIFIED) == 0) {
+        return make_not_modified_response(data, response);
+    }
+    if (strcmp(*data.status_code, HTTP_OK) != 0) {
+        return make_error_response(data, response);
+    }
+
+    return make_success_response(data, response);
+}
+
+int make_decision(http_request_t request, arena_t arena, http_response_t *response, http_status_code_t *status_code) {
     http_response_data_t data = {
+        .arena = arena,
         .status_code = status_code,
         .path = NULL,
         .proto = HTTP_1_1,
-        .need_body = false,
+        .need_body = true,
         .content_type = NULL,
-        .already_handled = false,
+        .cached = NULL,
     };
     http_method_t method;
     *status_code = HTTP_OK;
@@ -268,7 +607,6 @@ int make_decision(http_request_t request, http_response_t *response, http_status
 
     switch (method) {
         case GET:
-            data.need_body = true;
             break;
         case HEAD:
             data.need_body = false;
@@ -278,29 +616,91 @@ int make_decision(http_request_t request, http_response_t *response, http_status
             goto response;
     }
 
+    char *value = NULL;
+    if (http_request_get_header(request, HTTP_HEADER_RANGE, &value) == EXIT_SUCCESS) {
+        data.range = value;
+    }
+    if (http_request_get_header(request, HTTP_HEADER_IF_RANGE, &value) == EXIT_SUCCESS) {
+        data.if_range = value;
+    }
+    if (http_request_get_header(request, HTTP_HEADER_IF_NONE_MATCH, &value) == EXIT_SUCCESS) {
+        data.if_none_match = value;
+    }
+    if (http_request_get_header(request, HTTP_HEADER_IF_MODIFIED_SINCE, &value) == EXIT_SUCCESS) {
+        data.if_modified_since = value;
+    }
+
     if (validate_path(data.path) != EXIT_SUCCESS) {
         *status_code = HTTP_FORBIDDEN;
         goto response;
     }
 
     if (strlen(data.path) == strlen(STATIC_PATH) ||
-        (strlen(data.path) - strlen(STATIC_PATH) == 1 && data.path[strlen(data.path - 1)] == '/')) {
+        (strlen(data.path) - strlen(STATIC_PATH) == 1 && data.path[strlen(data.path) - 1] == '/')) {
         data.path = STATIC_PATH "/index.html";
     }
 
-    file_type_t type = get_file_info(data.path, &data.content_length);
-    if (type == DIRECTORY) {
-        *status_code = HTTP_NOT_IMPLEMENTED;
-        goto response;
-    } else if (type != REGULAR) {
-        *status_code = HTTP_NOT_FOUND;
+    // Cached files are answered without a path walk: from memory, or from a descriptor that is already open.
+    if (file_cache_lookup(data.path, &data.cached) == EXIT_SUCCESS) {
+        file_cache_entry_get_content_type(data.cached, &data.content_type);
+        use_cached_entry(&data);
+    } else {
+        file_info_t info;
+        file_type_t type = get_file_info(data.path, &info);
+        if (type == DIRECTORY) {
+            *status_code = HTTP_NOT_IMPLEMENTED;
+            goto response;
+        } else if (type != REGULAR) {
+            *status_code = HTTP_NOT_FOUND;
+            goto response;
+        }
+
+        data.content_length = info.size;
+        data.file_size = info.size;
+        data.mtime = info.mtime;
+        data.inode = info.inode;
+        data.content_type = mime_type_of(data.path);
+    }
+
+    if (is_compressible(data.content_type)) {
+        data.vary = true;
+        if (http_request_get_header(request, HTTP_HEADER_ACCEPT_ENCODING, &value) == EXIT_SUCCESS) {
+            select_sidecar(&data, value);
+            if (data.content_encoding == NULL) {
+                select_compression(&data, value);
+            }
+        }
+    }
+
+    // Revalidations are answered from the stat data, before the file is opened.
+    if (is_not_modified(data)) {
+        *status_code = HTTP_NOT_MODIFIED;
         goto response;
     }
 
-    if (detect_content_type(data.path, &data.content_type) != EXIT_SUCCESS) {
-        *status_code = HTTP_NOT_IMPLEMENTED;
+    // An entry carries the type of its own path: a sidecar is cached as itself, and only a negotiated response is
+    // labelled with the type of the file it was made from.
+    if (data.cached == NULL && file_cache_load(data.path, mime_type_of(data.path), &data.cached) == EXIT_SUCCESS) {
+        use_cached_entry(&data);
+    }
+    if (data.compress) {
+        use_compressed_variant(&data);
     }
 
 response:
     return make_response(data, response);
 }
+
+int make_error_decision(http_status_code_t status_code, arena_t arena, http_response_t *response) {
+    http_response_data_t data = {
+        .arena = arena,
+        .status_code = &status_code,
+        .path = NULL,
+        .proto = HTTP_1_1,
+        .need_body = true,
+        .content_type = NULL,
+        .cached = NULL,
+    };
+
+    return make_response(data, response);
+}
@@ -0,0 +1,108 @@
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include "encoding.h"
+
+static const char *skip_spaces(const char *p) {
+    while (*p == ' ' || *p == '\t') {
+        p++;
+    }
+
+    return p;
+}
+
+// qvalue = ( "0" [ "." 0*3DIGIT ] ) / ( "1" [ "." 0*3("0") ] ); anything else makes the element unusable.
+static bool parse_qvalue(const char *p, unsigned *weight) {
+    if (*p != '0' && *p != '1') {
+        return false;
+    }
+    unsigned value = (unsigned)(*p++ - '0') * HTTP_QVALUE_MAX;
+    if (*p == '.') {
+        p++;
+        for (unsigned scale = HTTP_QVALUE_MAX / 10; scale > 0 && *p >= '0' && *p <= '9'; scale /= 10, p++) {
+            value += (unsigned)(*p - '0') * scale;
+        }
+    }
+    p = skip_spaces(p);
+    if ((*p != '\0' && *p != ',' && *p != ';') || value > HTTP_QVALUE_MAX) {
+        return false;
+    }
+    *weight = value;
+
+    return true;
+}
+
+// x-gzip is still sent by some clients and means gzip.
+static bool coding_equals(const char *token, size_t length, const char *coding) {
+    if (length == strlen(coding) && strncasecmp(token, coding, length) == 0) {
+        return true;
+    }
+
+    return strcmp(coding, "gzip") == 0 && length == 6 && strncasecmp(token, "x-gzip", 6) == 0;
+}
+
+// Returns the weight the header gives coding by name or through "*"; listed tells whether it does either.
+static unsigned listed_weight(const char *accept_encoding, const char *coding, bool *listed) {
+    *listed = true;
+    bool any_listed = false;
+    unsigned any_weight = 0;
+
+    const char *p = accept_encoding;
+    while (*p != '\0') {
+        p = skip_spaces(p);
+        const char *token = p;
+        while (*p != '\0' && *p != ',' && *p != ';' && *p != ' ' && *p != '\t') {
+            p++;
+        }
+        size_t length = (size_t)(p - token);
+
+        unsigned weight = HTTP_QVALUE_MAX;
+        bool valid = true;
+        p = skip_spaces(p);
+        while (*p == ';') {
+            p = skip_spaces(p + 1);
+            if ((p[0] == 'q' || p[0] == 'Q') && p[1] == '=') {
+                valid = parse_qvalue(p + 2, &weight);
+            }
+            while (*p != '\0' && *p != ',' && *p != ';') {
+                p++;
+            }
+        }
+        if (*p == ',') {
+            p++;
+        }
+
+        if (!valid || length == 0) {
+            continue;
+        }
+        if (coding_equals(token, length, coding)) {
+            return weight;
+        }
+        if (length == 1 && token[0] == '*') {
+            any_listed = true;
+            any_weight = weight;
+        }
+    }
+
+    if (any_listed) {
+        return any_weight;
+    }
+    *listed = false;
+
+    return 0;
+}
+
+unsigned http_accept_encoding_weight(const char *accept_encoding, const char *coding) {
+    bool listed;
+    unsigned weight = listed_weight(accept_encoding, coding, &listed);
+    if (!listed && strcasecmp(coding, "identity") == 0) {
+        return HTTP_QVALUE_MAX;
+    }
+
+    return weight;
+}
+
+unsigned http_accept_encoding_identity_rank(const char *accept_encoding) {
+    bool listed;
+    return listed_weight(accept_encoding, "identity", &listed);
+}
@@ -1,23 +1,159 @@
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <strings.h>
+#include <ctype.h>
 #include <errno.h>
+#include <sys/socket.h>
 #include "events_handler.h"
 #include "decisions_maker.h"
 #include "request.h"
+#include "parser.h"
+#include "arena.h"
+#include "fs.h"
 #include "log.h"
 
-static int read_http_request(int socket_fd, char *raw_request) {
-    ssize_t n = read(socket_fd, raw_request, REQUEST_BUFFER_SIZE - 1);
+#define HTTP_BATCH_MAX_RESPONSES 32
+#define HTTP_ARENA_BLOCK_SIZE (16 * 1024)
+
+typedef struct http_exchange {
+    http_request_t request;
+    http_response_t response;
+    http_status_code_t status_code;
+} http_exchange_t;
+
+// Responses to pipelined requests, queued in order and sent with one gathered write. sent counts the bytes of iov
+// that are out already when the socket could not take all of it at once.
+typedef struct http_batch {
+    http_exchange_t exchanges[HTTP_BATCH_MAX_RESPONSES];
+    size_t count;
+    struct iovec iov[HTTP_BATCH_MAX_RESPONSES * HTTP_RESPONSE_IOV_COUNT];
+    size_t iov_count;
+    size_t sent;
+} http_batch_t;
+
+// Bytes received on a connection that do not form a complete request yet survive between wakeups,
+// together with the parser state for them. Requests and responses are allocated in the arena,
+// which is reset once every response to a read has been sent.
+// While the socket is full, the batch being sent waits in the arena, and consumed and reuse tell where serving the
+// buffer goes on once it is out.
+struct http_connection {
+    unsigned requests;
+    char *buffer;
+    size_t length;
+    size_t consumed;
+    bool reuse;
+    http_parser_t parser;
+    arena_t arena;
+    http_batch_t *batch;
+};
+
+static struct http_connection *connections = NULL;
+static size_t connections_count = 0;
+static unsigned max_requests = 0;
+
+int http_events_init(size_t max_connections, unsigned max_requests_per_connection) {
+    struct http_connection *tmp = calloc(max_connections, sizeof(struct http_connection));
+    if (tmp == NULL) {
+        log_error("http_events_init calloc() connections: %s", strerror(errno));
+        return errno;
+    }
+
+    connections = tmp;
+    connections_count = max_connections;
+    max_requests = max_requests_per_connection;
+
+    return EXIT_SUCCESS;
+}
+
+static int read_http_request(int socket_fd, struct http_connection *connection, size_t *size) {
+    if (connection->buffer == NULL) {
+        if ((connection->buffer = malloc(REQUEST_BUFFER_SIZE)) == NULL) {
+            log_error("read_http_request malloc() buffer: %s", strerror(errno));
+            return errno;
+        }
+        connection->length = 0;
+        http_parser_reset(&connection->parser);
+    }
+    if (connection->arena == NULL) {
+        int rc = arena_create(&connection->arena, HTTP_ARENA_BLOCK_SIZE);
+        if (rc != EXIT_SUCCESS) {
+            return rc;
+        }
+    }
+
+    ssize_t n;
+    while ((n = read(socket_fd, connection->buffer + connection->length,
+                     REQUEST_BUFFER_SIZE - connection->length)) == -1 && errno == EINTR);
     if (n < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return EAGAIN;
+        }
         log_error("read() from fd %d: %s", socket_fd, strerror(errno));
         return errno;
     }
-    raw_request[n] = '\0';
+    connection->length += (size_t)n;
+    *size = (size_t)n;
 
     return EXIT_SUCCESS;
 }
 
+// Checks a comma-separated header value such as "keep-alive, Upgrade" for a token, ignoring case.
+static bool header_has_token(const char *value, const char *token) {
+    size_t token_len = strlen(token);
+    const char *p = value;
+    while (*p != '\0') {
+        while (*p == ' ' || *p == '\t' || *p == ',') {
+            p++;
+        }
+        const char *start = p;
+        while (*p != '\0' && *p != ',') {
+            p++;
+        }
+        const char *end = p;
+        while (end > start && isspace((unsigned char)end[-1])) {
+            end--;
+        }
+        if ((size_t)(end - start) == token_len && strncasecmp(start, token, token_len) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool http_request_wants_keep_alive(http_request_t request) {
+    http_proto_t proto = NULL;
+    if (http_request_get_proto(request, &proto) != EXIT_SUCCESS) {
+        return false;
+    }
+
+    char *connection = NULL;
+    bool has_connection = http_request_get_header(request, HTTP_HEADER_CONNECTION, &connection) == EXIT_SUCCESS;
+    if (has_connection && header_has_token(connection, "close")) {
+        return false;
+    }
+    if (strcmp(proto, HTTP_1_1) == 0) {
+        return true;
+    }
+
+    return has_connection && header_has_token(connection, "keep-alive");
+}
+
+// Request bodies are never read, so a connection cannot be reused after a request that announces one.
+static bool http_request_has_body(http_request_t request) {
+    char *value = NULL;
+    if (http_request_get_header(request, HTTP_HEADER_TRANSFER_ENCODING, &value) == EXIT_SUCCESS) {
+        return true;
+    }
+    if (http_request_get_header(request, HTTP_HEADER_CONTENT_LENGTH, &value) == EXIT_SUCCESS) {
+        return strcmp(value, "0") != 0;
+    }
+
+    return false;
+}
+
 static int log_http_request(http_request_t request) {
     char *path = NULL;
     int rc = http_request_get_path(request, &path);
@@ -62,7 +198,7 @@ static int log_http_response(http_request_t request, http_status_code_t status_c
         return rc;
     }
 
-    if (strcmp(status_code, HTTP_OK) == 0) {
+    if (status_code[0] == '2' || status_code[0] == '3') {
         log_info("\033[0;32m%c%c%c %s %s by %s --- %d ms\033[0m",
             status_code[0], status_code[1], status_code[2], http_method_mapping(method), path, proto, processing_time
         );
@@ -75,16 +211,18 @@ static int log_http_response(http_request_t request, http_status_code_t status_c
     return EXIT_SUCCESS;
 }
 
-int handle_http_event(int socket_fd) {
-    // log_info("process request from client (fd = %d) ...", socket_fd);
-    char raw_request[REQUEST_BUFFER_SIZE] = {'\0'};
-    int rc = read_http_request(socket_fd, raw_request);
-    if (rc != EXIT_SUCCESS) {
-        return rc;
+static void http_exchange_destroy(http_exchange_t *exchange) {
+    if (exchange->response != NULL) {
+        http_response_close_attachment(exchange->response);
+        http_response_destroy(&exchange->response);
     }
+    http_request_destroy(&exchange->request);
+}
 
+static int http_exchange_create(struct http_connection *connection, char *raw_request,
+                                http_exchange_t *exchange, bool *keep_alive) {
     http_request_t request = NULL;
-    rc = http_request_create(&request, raw_request);
+    int rc = http_request_create(&request, connection->arena, raw_request, &connection->parser);
     if (rc != EXIT_SUCCESS) {
         return rc;
     }
@@ -97,22 +235,238 @@ int handle_http_event(int socket_fd) {
 
     http_response_t response = NULL;
     http_status_code_t status_code = NULL;
-    rc = make_decision(request, &response, &status_code);
+    rc = make_decision(request, connection->arena, &response, &status_code);
     if (rc != EXIT_SUCCESS) {
         http_request_destroy(&request);
         return rc;
     }
 
-    rc = http_response_write(response, socket_fd);
-    http_response_close_attachment(response);
-    http_response_destroy(&response);
-    if (rc != EXIT_SUCCESS) {
+    connection->requests++;
+    *keep_alive = http_request_wants_keep_alive(request) && !http_request_has_body(request) &&
+                  connection->requests < max_requests;
+    if ((rc = http_response_set_keep_alive(response, *keep_alive)) != EXIT_SUCCESS) {
+        http_response_destroy(&response);
         http_request_destroy(&request);
         return rc;
     }
 
-    rc = log_http_response(request, status_code);
-    http_request_destroy(&request);
+    exchange->request = request;
+    exchange->response = response;
+    exchange->status_code = status_code;
+
+    return EXIT_SUCCESS;
+}
+
+static void http_batch_discard(http_batch_t *batch) {
+    for (size_t i = 0; i < batch->count; i++) {
+        http_exchange_destroy(&batch->exchanges[i]);
+    }
+    batch->count = 0;
+    batch->iov_count = 0;
+    batch->sent = 0;
+}
+
+// Sends the queued responses with one gathered write, then the file body of the last response if it has one.
+// Returns EAGAIN when the socket is full; the batch keeps its progress and is flushed again once it is writable.
+static int http_batch_flush(http_batch_t *batch, int socket_fd) {
+    int rc = EXIT_SUCCESS;
+    http_response_t last = batch->count > 0 ? batch->exchanges[batch->count - 1].response : NULL;
+    if (batch->iov_count > 0) {
+        // With a file body to follow, MSG_MORE keeps the kernel from pushing the heads out as a short segment.
+        int flags = last != NULL && http_response_has_attachment(last) ? MSG_MORE : 0;
+        if ((rc = send_iov(socket_fd, batch->iov, batch->iov_count, &batch->sent, flags)) == EAGAIN) {
+            return rc;
+        }
+        if (rc != EXIT_SUCCESS) {
+            log_error("sendmsg() to fd %d: %s", socket_fd, strerror(rc));
+        }
+    }
+    if (rc == EXIT_SUCCESS && last != NULL && (rc = http_response_write_attachment(last, socket_fd)) == EAGAIN) {
+        return rc;
+    }
+
+    for (size_t i = 0; i < batch->count; i++) {
+        // Error responses to unparsable requests have no request to log.
+        if (rc == EXIT_SUCCESS && batch->exchanges[i].request != NULL) {
+            log_http_response(batch->exchanges[i].request, batch->exchanges[i].status_code);
+        }
+    }
+    http_batch_discard(batch);
 
     return rc;
 }
+
+// Takes ownership of the exchange; the batch must have room for it. Bodies are streamed from files, so a response
+// with one ends the batch.
+static int http_batch_add(http_batch_t *batch, int socket_fd, http_exchange_t exchange) {
+    size_t n = 0;
+    int rc = http_response_head_iov(exchange.response, batch->iov + batch->iov_count, HTTP_RESPONSE_IOV_COUNT, &n);
+    if (rc != EXIT_SUCCESS) {
+        http_exchange_destroy(&exchange);
+        return rc;
+    }
+    batch->iov_count += n;
+    batch->exchanges[batch->count++] = exchange;
+
+    if (http_response_has_attachment(exchange.response)) {
+        return http_batch_flush(batch, socket_fd);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// Answers a request that could not be parsed, after the responses queued before it; the connection is closed
+// afterwards.
+static int http_batch_add_error(http_batch_t *batch, int socket_fd, arena_t arena, http_status_code_t status_code) {
+    http_response_t response = NULL;
+    int rc = make_error_decision(status_code, arena, &response);
+    if (rc != EXIT_SUCCESS) {
+        return rc;
+    }
+    if ((rc = http_response_set_keep_alive(response, false)) != EXIT_SUCCESS) {
+        http_response_destroy(&response);
+        return rc;
+    }
+
+    http_exchange_t exchange = {
+        .request = NULL,
+        .response = response,
+        .status_code = status_code,
+    };
+
+    return http_batch_add(batch, socket_fd, exchange);
+}
+
+// Answers every complete request in the buffer from connection->consumed on; pipelined responses go out together.
+static int serve_buffered_requests(struct http_connection *connection, int socket_fd, http_event_next_t *next) {
+    http_batch_t *batch = connection->batch;
+    int rc = EXIT_SUCCESS;
+    while (connection->reuse && connection->consumed < connection->length) {
+        if (batch->count == HTTP_BATCH_MAX_RESPONSES && (rc = http_batch_flush(batch, socket_fd)) != EXIT_SUCCESS) {
+            break;
+        }
+
+        char *raw_request = connection->buffer + connection->consumed;
+        int parsed = http_parser_execute(&connection->parser, raw_request, connection->length - connection->consumed);
+        if (parsed == HTTP_PARSER_AGAIN) {
+            break;
+        }
+        if (parsed != HTTP_PARSER_DONE) {
+            log_warn("malformed request from fd %d", socket_fd);
+            rc = http_batch_add_error(batch, socket_fd, connection->arena,
+                                      parsed == HTTP_PARSER_TOO_LARGE ? HTTP_HEADERS_TOO_LARGE : HTTP_BAD_REQUEST);
+            connection->reuse = false;
+            break;
+        }
+        connection->consumed += connection->parser.position;
+
+        http_exchange_t exchange;
+        rc = http_exchange_create(connection, raw_request, &exchange, &connection->reuse);
+        http_parser_reset(&connection->parser);
+        if (rc == INVALID_HTTP_REQUEST) {
+            rc = http_batch_add_error(batch, socket_fd, connection->arena, HTTP_BAD_REQUEST);
+            connection->reuse = false;
+            break;
+        }
+        if (rc != EXIT_SUCCESS) {
+            break;
+        }
+        if ((rc = http_batch_add(batch, socket_fd, exchange)) != EXIT_SUCCESS) {
+            break;
+        }
+    }
+
+    if (rc != EXIT_SUCCESS && rc != EAGAIN) {
+        // What is queued still goes out, but the connection is not read from again.
+        connection->reuse = false;
+    }
+    int flush_rc = rc == EAGAIN ? EAGAIN : http_batch_flush(batch, socket_fd);
+    if (flush_rc == EAGAIN) {
+        *next = HTTP_EVENT_WRITE;
+        return EXIT_SUCCESS;
+    }
+
+    connection->batch = NULL;
+    arena_reset(connection->arena);
+    if (rc != EXIT_SUCCESS || flush_rc != EXIT_SUCCESS || !connection->reuse) {
+        return rc != EXIT_SUCCESS ? rc : flush_rc;
+    }
+
+    // Keep the beginning of the next request for the next wakeup; the parser state is relative to it.
+    memmove(connection->buffer, connection->buffer + connection->consumed, connection->length - connection->consumed);
+    connection->length -= connection->consumed;
+    connection->consumed = 0;
+    *next = HTTP_EVENT_READ;
+
+    return EXIT_SUCCESS;
+}
+
+int handle_http_event(int socket_fd, http_event_next_t *next) {
+    *next = HTTP_EVENT_CLOSE;
+    struct http_connection *connection = &connections[socket_fd];
+    int rc;
+    if (connection->batch != NULL) {
+        // The socket has room again: the responses that did not fit go out whole before the requests behind them
+        // are answered, so nothing is queued behind a body that is half sent.
+        if ((rc = http_batch_flush(connection->batch, socket_fd)) == EAGAIN) {
+            *next = HTTP_EVENT_WRITE;
+            return EXIT_SUCCESS;
+        }
+        if (rc != EXIT_SUCCESS) {
+            connection->batch = NULL;
+            arena_reset(connection->arena);
+            return rc;
+        }
+        return serve_buffered_requests(connection, socket_fd, next);
+    }
+
+    size_t size = 0;
+    rc = read_http_request(socket_fd, connection, &size);
+    if (rc == EAGAIN) {
+        // Spurious wakeup: nothing to read yet, keep waiting.
+        *next = HTTP_EVENT_READ;
+        return EXIT_SUCCESS;
+    }
+    if (rc != EXIT_SUCCESS || size == 0) {
+        return rc;
+    }
+
+    http_batch_t *batch = arena_alloc(connection->arena, sizeof(http_batch_t));
+    if (batch == NULL) {
+        log_error("handle_http_event arena_alloc() batch: %s", strerror(errno));
+        return errno;
+    }
+    batch->count = 0;
+    batch->iov_count = 0;
+    batch->sent = 0;
+    connection->batch = batch;
+    connection->consumed = 0;
+    connection->reuse = true;
+
+    return serve_buffered_requests(connection, socket_fd, next);
+}
+
+void http_events_close(int socket_fd) {
+    if (socket_fd >= 0 && (size_t)socket_fd < connections_count) {
+        if (connections[socket_fd].batch != NULL) {
+            http_batch_discard(connections[socket_fd].batch);
+        }
+        free(connections[socket_fd].buffer);
+        arena_destroy(&connections[socket_fd].arena);
+        memset(&connections[socket_fd], 0, sizeof(struct http_connection));
+    }
+    close(socket_fd);
+}
+
+void http_events_destroy(void) {
+    for (size_t i = 0; i < connections_count; i++) {
+        if (connections[i].batch != NULL) {
+            http_batch_discard(connections[i].batch);
+        }
+        free(connections[i].buffer);
+        arena_destroy(&connections[i].arena);
+    }
+    free(connections);
+    connections = NULL;
+    connections_count = 0;
+}
@@ -0,0 +1,683 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <poll.h>
+#include <pthread.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+#include "file_cache.h"
+#include "log.h"
+
+#define FILE_CACHE_WATCH_MASK (IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM | \
+                               IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_DONT_FOLLOW)
+#define FILE_CACHE_EVENTS_BUFFER_SIZE (64 * 1024)
+
+struct file_cache_shard;
+
+typedef enum file_cache_kind {
+    FILE_CACHE_CONTENT,     // the file is kept in memory
+    FILE_CACHE_FD,          // too large for that: an open descriptor is kept and shared by all senders
+} file_cache_kind_t;
+
+// An entry stays allocated while it is linked into its shard or referenced by a response being sent.
+struct file_cache_entry {
+    struct file_cache_shard *shard;
+    file_cache_kind_t kind;
+    struct file_cache_entry *hash_next;
+    struct file_cache_entry *lru_prev;
+    struct file_cache_entry *lru_next;
+    uint64_t hash;
+    char *path;
+    char *data;
+    int fd;
+    size_t length;
+    const char *content_type;
+    struct timespec mtime;
+    ino_t inode;
+    unsigned refs;
+    bool linked;
+};
+
+// Every shard keeps an LRU list per entry kind under its own lock. The generation changes whenever an entry of the
+// shard may have gone stale, so a load that raced with a change does not insert what it read.
+struct file_cache_shard {
+    pthread_mutex_t mutex;
+    struct file_cache_entry *buckets[FILE_CACHE_SHARD_BUCKETS];
+    struct file_cache_entry lru[2];     // sentinels by kind: lru_next is the most recently used entry
+    size_t bytes;
+    size_t entries;
+    size_t fds;
+    unsigned long generation;
+};
+
+struct file_cache {
+    bool enabled;
+    bool watching;
+    char *root;
+    size_t root_length;
+    size_t shard_max_bytes;
+    size_t shard_max_entries;
+    size_t max_file_size;
+    size_t shard_max_fds;
+    struct file_cache_shard shards[FILE_CACHE_SHARDS];
+    int inotify_fd;
+    int stop_fd;
+    pthread_t watcher;
+    pthread_mutex_t watches_mutex;
+    char **watches;                 // watched directory by watch descriptor
+    size_t watches_capacity;
+};
+
+static struct file_cache cache = {
+    .inotify_fd = -1,
+    .stop_fd = -1,
+};
+
+static bool file_cache_enabled(void) {
+    return __atomic_load_n(&cache.enabled, __ATOMIC_ACQUIRE);
+}
+
+static uint64_t hash_path(const char *path) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (const unsigned char *p = (const unsigned char *)path; *p != '\0'; p++) {
+        hash ^= *p;
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+static struct file_cache_shard *shard_of(uint64_t hash) {
+    return &cache.shards[hash % FILE_CACHE_SHARDS];
+}
+
+static struct file_cache_entry **bucket_of(struct file_cache_shard *shard, uint64_t hash) {
+    return &shard->buckets[(hash / FILE_CACHE_SHARDS) % FILE_CACHE_SHARD_BUCKETS];
+}
+
+static void entry_free(struct file_cache_entry *entry) {
+    if (entry->fd != -1) {
+        close(entry->fd);
+    }
+    free(entry->path);
+    free(entry->data);
+    free(entry);
+}
+
+static struct file_cache_entry *shard_find(struct file_cache_shard *shard, uint64_t hash, const char *path) {
+    for (struct file_cache_entry *entry = *bucket_of(shard, hash); entry != NULL; entry = entry->hash_next) {
+        if (entry->hash == hash && strcmp(entry->path, path) == 0) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+static void lru_remove(struct file_cache_entry *entry) {
+    entry->lru_prev->lru_next = entry->lru_next;
+    entry->lru_next->lru_prev = entry->lru_prev;
+}
+
+static void lru_push_front(struct file_cache_shard *shard, struct file_cache_entry *entry) {
+    struct file_cache_entry *lru = &shard->lru[entry->kind];
+    entry->lru_prev = lru;
+    entry->lru_next = lru->lru_next;
+    lru->lru_next->lru_prev = entry;
+    lru->lru_next = entry;
+}
+
+static void shard_link(struct file_cache_shard *shard, struct file_cache_entry *entry) {
+    struct file_cache_entry **bucket = bucket_of(shard, entry->hash);
+    entry->hash_next = *bucket;
+    *bucket = entry;
+    lru_push_front(shard, entry);
+    entry->linked = true;
+    if (entry->kind == FILE_CACHE_FD) {
+        shard->fds++;
+    } else {
+        shard->bytes += entry->length;
+        shard->entries++;
+    }
+}
+
+// Must be called with the shard locked; the entry is freed here unless a response still references it.
+static void shard_unlink(struct file_cache_shard *shard, struct file_cache_entry *entry) {
+    struct file_cache_entry **link = bucket_of(shard, entry->hash);
+    while (*link != entry) {
+        link = &(*link)->hash_next;
+    }
+    *link = entry->hash_next;
+    lru_remove(entry);
+    entry->linked = false;
+    if (entry->kind == FILE_CACHE_FD) {
+        shard->fds--;
+    } else {
+        shard->bytes -= entry->length;
+        shard->entries--;
+    }
+
+    if (entry->refs == 0) {
+        entry_free(entry);
+    }
+}
+
+// Descriptors of evicted entries stay open until their last sender releases them.
+static void shard_evict(struct file_cache_shard *shard) {
+    struct file_cache_entry *content = &shard->lru[FILE_CACHE_CONTENT];
+    while (shard->entries > 0 && (shard->bytes > cache.shard_max_bytes || shard->entries > cache.shard_max_entries)) {
+        shard_unlink(shard, content->lru_prev);
+    }
+    struct file_cache_entry *fds = &shard->lru[FILE_CACHE_FD];
+    while (shard->fds > cache.shard_max_fds) {
+        shard_unlink(shard, fds->lru_prev);
+    }
+}
+
+static void file_cache_invalidate(const char *path) {
+    uint64_t hash = hash_path(path);
+    struct file_cache_shard *shard = shard_of(hash);
+
+    pthread_mutex_lock(&shard->mutex);
+    shard->generation++;
+    struct file_cache_entry *entry = shard_find(shard, hash, path);
+    if (entry != NULL) {
+        log_debug("file cache: invalidate %s", path);
+        shard_unlink(shard, entry);
+    }
+    pthread_mutex_unlock(&shard->mutex);
+}
+
+static void file_cache_flush(void) {
+    for (size_t i = 0; i < FILE_CACHE_SHARDS; i++) {
+        struct file_cache_shard *shard = &cache.shards[i];
+        pthread_mutex_lock(&shard->mutex);
+        shard->generation++;
+        for (int kind = FILE_CACHE_CONTENT; kind <= FILE_CACHE_FD; kind++) {
+            struct file_cache_entry *lru = &shard->lru[kind];
+            while (lru->lru_next != lru) {
+                shard_unlink(shard, lru->lru_next);
+            }
+        }
+        pthread_mutex_unlock(&shard->mutex);
+    }
+}
+
+// Without working change notifications nothing cached can be trusted, so caching stops for good.
+static void file_cache_disable(void) {
+    log_warn("file cache disabled");
+    __atomic_store_n(&cache.enabled, false, __ATOMIC_RELEASE);
+    file_cache_flush();
+}
+
+static int watches_set(int wd, const char *path) {
+    char *tmp_path = strdup(path);
+    if (tmp_path == NULL) {
+        log_error("file cache strdup() watch path: %s", strerror(errno));
+        return errno;
+    }
+
+    pthread_mutex_lock(&cache.watches_mutex);
+    if ((size_t)wd >= cache.watches_capacity) {
+        size_t capacity = cache.watches_capacity == 0 ? 64 : cache.watches_capacity;
+        while (capacity <= (size_t)wd) {
+            capacity *= 2;
+        }
+        char **tmp = realloc(cache.watches, capacity * sizeof(char *));
+        if (tmp == NULL) {
+            int rc = errno;
+            pthread_mutex_unlock(&cache.watches_mutex);
+            log_error("file cache realloc() watches: %s", strerror(rc));
+            free(tmp_path);
+            return rc;
+        }
+        memset(tmp + cache.watches_capacity, 0, (capacity - cache.watches_capacity) * sizeof(char *));
+        cache.watches = tmp;
+        cache.watches_capacity = capacity;
+    }
+    free(cache.watches[wd]);
+    cache.watches[wd] = tmp_path;
+    pthread_mutex_unlock(&cache.watches_mutex);
+
+    return EXIT_SUCCESS;
+}
+
+static void watches_forget(int wd) {
+    pthread_mutex_lock(&cache.watches_mutex);
+    if (wd >= 0 && (size_t)wd < cache.watches_capacity) {
+        free(cache.watches[wd]);
+        cache.watches[wd] = NULL;
+    }
+    pthread_mutex_unlock(&cache.watches_mutex);
+}
+
+// A file may only be cached when the directory it is looked up through is watched, which rules out
+// directories reached through symlinks.
+static bool watches_cover(const char *path) {
+    const char *slash = strrchr(path, '/');
+    size_t dir_length = (size_t)(slash - path);
+    bool found = false;
+
+    pthread_mutex_lock(&cache.watches_mutex);
+    for (size_t i = 0; i < cache.watches_capacity && !found; i++) {
+        const char *dir = cache.watches[i];
+        found = dir != NULL && strlen(dir) == dir_length && strncmp(dir, path, dir_length) == 0;
+    }
+    pthread_mutex_unlock(&cache.watches_mutex);
+
+    return found;
+}
+
+static int watch_tree(const char *path) {
+    int wd = inotify_add_watch(cache.inotify_fd, path, FILE_CACHE_WATCH_MASK);
+    if (wd == -1) {
+        log_warn("inotify_add_watch(%s): %s", path, strerror(errno));
+        return errno;
+    }
+    int rc = watches_set(wd, path);
+    if (rc != EXIT_SUCCESS) {
+        return rc;
+    }
+
+    DIR *dir = opendir(path);
+    if (dir == NULL) {
+        log_warn("opendir(%s): %s", path, strerror(errno));
+        return errno;
+    }
+    struct dirent *entry;
+    while (rc == EXIT_SUCCESS && (entry = readdir(dir)) != NULL) {
+        if (entry->d_type != DT_DIR || strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        char *child = NULL;
+        if (asprintf(&child, "%s/%s", path, entry->d_name) == -1) {
+            log_error("file cache asprintf(): %s", strerror(errno));
+            rc = ENOMEM;
+            break;
+        }
+        rc = watch_tree(child);
+        free(child);
+    }
+    closedir(dir);
+
+    return rc;
+}
+
+static bool handle_inotify_event(const struct inotify_event *event) {
+    if (event->mask & IN_Q_OVERFLOW) {
+        log_warn("file cache: inotify queue overflow; drop all entries");
+        file_cache_flush();
+        return true;
+    }
+    if (event->mask & IN_IGNORED) {
+        watches_forget(event->wd);
+        return true;
+    }
+
+    pthread_mutex_lock(&cache.watches_mutex);
+    char *dir = NULL;
+    if ((size_t)event->wd < cache.watches_capacity && cache.watches[event->wd] != NULL) {
+        dir = strdup(cache.watches[event->wd]);
+    }
+    pthread_mutex_unlock(&cache.watches_mutex);
+    if (dir == NULL) {
+        return true;
+    }
+
+    bool ok = true;
+    if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+        // Everything below the directory is now reachable, if at all, through another path.
+        if (strcmp(dir, cache.root) == 0) {
+            ok = false;
+        } else {
+            inotify_rm_watch(cache.inotify_fd, event->wd);
+            watches_forget(event->wd);
+            file_cache_flush();
+        }
+    } else if (event->len > 0) {
+        char *path = NULL;
+        if (asprintf(&path, "%s/%s", dir, event->name) == -1) {
+            log_error("file cache asprintf(): %s", strerror(errno));
+            ok = false;
+        } else if (event->mask & IN_ISDIR) {
+            if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                file_cache_flush();
+            }
+            if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                ok = watch_tree(path) == EXIT_SUCCESS;
+            }
+        } else {
+            file_cache_invalidate(path);
+        }
+        free(path);
+    }
+    free(dir);
+
+    return ok;
+}
+
+static void *file_cache_watch(void *arg) {
+    (void)arg;
+    static char buffer[FILE_CACHE_EVENTS_BUFFER_SIZE] __attribute__((aligned(__alignof__(struct inotify_event))));
+    struct pollfd fds[2] = {
+        { .fd = cache.inotify_fd, .events = POLLIN },
+        { .fd = cache.stop_fd, .events = POLLIN },
+    };
+
+    while (1) {
+        if (poll(fds, 2, -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            log_error("file cache poll(): %s", strerror(errno));
+            break;
+        }
+        if (fds[1].revents != 0) {
+            return NULL;
+        }
+
+        ssize_t n = read(cache.inotify_fd, buffer, sizeof(buffer));
+        if (n <= 0) {
+            if (n == -1 && (errno == EINTR || errno == EAGAIN)) {
+                continue;
+            }
+            log_error("file cache read() inotify: %s", n == 0 ? "end of file" : strerror(errno));
+            break;
+        }
+
+        bool ok = true;
+        for (char *p = buffer; ok && p < buffer + n;) {
+            const struct inotify_event *event = (const struct inotify_event *)p;
+            ok = handle_inotify_event(event);
+            p += sizeof(struct inotify_event) + event->len;
+        }
+        if (!ok) {
+            break;
+        }
+    }
+
+    file_cache_disable();
+    return NULL;
+}
+
+int file_cache_init(const char *root, size_t max_bytes, size_t max_entries, size_t max_file_size,
+                    size_t max_open_files) {
+    if (max_bytes == 0 || max_entries == 0) {
+        max_file_size = 0;
+    }
+    if (max_file_size == 0 && max_open_files == 0) {
+        log_info("file cache is off");
+        return EXIT_SUCCESS;
+    }
+
+    int rc;
+    for (size_t i = 0; i < FILE_CACHE_SHARDS; i++) {
+        struct file_cache_shard *shard = &cache.shards[i];
+        if ((rc = pthread_mutex_init(&shard->mutex, NULL)) != 0) {
+            log_error("file_cache_init pthread_mutex_init(): %s", strerror(rc));
+            return rc;
+        }
+        for (int kind = FILE_CACHE_CONTENT; kind <= FILE_CACHE_FD; kind++) {
+            shard->lru[kind].lru_next = &shard->lru[kind];
+            shard->lru[kind].lru_prev = &shard->lru[kind];
+        }
+    }
+    if ((rc = pthread_mutex_init(&cache.watches_mutex, NULL)) != 0) {
+        log_error("file_cache_init pthread_mutex_init(): %s", strerror(rc));
+        return rc;
+    }
+    if ((cache.root = strdup(root)) == NULL) {
+        log_error("file_cache_init strdup() root: %s", strerror(errno));
+        return errno;
+    }
+    cache.root_length = strlen(root);
+    cache.shard_max_bytes = max_bytes / FILE_CACHE_SHARDS > 0 ? max_bytes / FILE_CACHE_SHARDS : 1;
+    cache.shard_max_entries = max_entries / FILE_CACHE_SHARDS > 0 ? max_entries / FILE_CACHE_SHARDS : 1;
+    cache.max_file_size = max_file_size < cache.shard_max_bytes ? max_file_size : cache.shard_max_bytes;
+    cache.shard_max_fds = (max_open_files + FILE_CACHE_SHARDS - 1) / FILE_CACHE_SHARDS;
+
+    // Serving from memory is only safe while changes are reported, so the cache stays off without inotify.
+    if ((cache.inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1) {
+        log_warn("inotify_init1(): %s; file cache is off", strerror(errno));
+        return EXIT_SUCCESS;
+    }
+    if ((cache.stop_fd = eventfd(0, EFD_CLOEXEC)) == -1) {
+        log_error("file_cache_init eventfd(): %s", strerror(errno));
+        return errno;
+    }
+    if (watch_tree(root) != EXIT_SUCCESS) {
+        log_warn("cannot watch %s; file cache is off", root);
+        return EXIT_SUCCESS;
+    }
+    if ((rc = pthread_create(&cache.watcher, NULL, file_cache_watch, NULL)) != 0) {
+        log_error("file_cache_init pthread_create(): %s", strerror(rc));
+        return rc;
+    }
+    cache.watching = true;
+    __atomic_store_n(&cache.enabled, true, __ATOMIC_RELEASE);
+    log_info("file cache: %lu bytes, %lu entries, files up to %lu bytes; %lu open files",
+             cache.shard_max_bytes * FILE_CACHE_SHARDS, cache.shard_max_entries * FILE_CACHE_SHARDS, cache.max_file_size,
+             cache.shard_max_fds * FILE_CACHE_SHARDS);
+
+    return EXIT_SUCCESS;
+}
+
+int file_cache_lookup(const char *path, file_cache_entry_t *entry) {
+    if (!file_cache_enabled()) {
+        return FILE_CACHE_MISS;
+    }
+
+    uint64_t hash = hash_path(path);
+    struct file_cache_shard *shard = shard_of(hash);
+
+    pthread_mutex_lock(&shard->mutex);
+    struct file_cache_entry *found = shard_find(shard, hash, path);
+    if (found != NULL) {
+        lru_remove(found);
+        lru_push_front(shard, found);
+        found->refs++;
+    }
+    pthread_mutex_unlock(&shard->mutex);
+
+    if (found == NULL) {
+        return FILE_CACHE_MISS;
+    }
+    *entry = found;
+
+    return EXIT_SUCCESS;
+}
+
+// inotify reports names relative to watched directories, so only the canonical spelling of a path below the
+// root can be invalidated reliably.
+static bool path_is_cacheable(const char *path) {
+    if (strncmp(path, cache.root, cache.root_length) != 0 || path[cache.root_length] != '/') {
+        return false;
+    }
+    for (const char *p = path + cache.root_length; *p != '\0'; p++) {
+        if (*p != '/') {
+            continue;
+        }
+        if (p[1] == '/' || p[1] == '\0') {
+            return false;
+        }
+        if (p[1] == '.' && (p[2] == '/' || p[2] == '\0' || (p[2] == '.' && (p[3] == '/' || p[3] == '\0')))) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static int read_file(int fd, char *data, size_t length) {
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = read(fd, data + done, length - done);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return n == 0 ? EIO : errno;
+        }
+        done += (size_t)n;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int file_cache_load(const char *path, const char *content_type, file_cache_entry_t *entry) {
+    if (!file_cache_enabled() || !path_is_cacheable(path) || !watches_cover(path)) {
+        return FILE_CACHE_MISS;
+    }
+
+    uint64_t hash = hash_path(path);
+    struct file_cache_shard *shard = shard_of(hash);
+    pthread_mutex_lock(&shard->mutex);
+    unsigned long generation = shard->generation;
+    pthread_mutex_unlock(&shard->mutex);
+
+    int fd = open(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd == -1) {
+        return FILE_CACHE_MISS;
+    }
+
+    struct file_cache_entry *tmp = NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        goto miss;
+    }
+    file_cache_kind_t kind = (size_t)st.st_size <= cache.max_file_size ? FILE_CACHE_CONTENT : FILE_CACHE_FD;
+    if (kind == FILE_CACHE_FD && cache.shard_max_fds == 0) {
+        goto miss;
+    }
+    if ((tmp = calloc(1, sizeof(struct file_cache_entry))) == NULL) {
+        log_error("file_cache_load calloc() entry: %s", strerror(errno));
+        goto miss;
+    }
+    tmp->kind = kind;
+    tmp->fd = -1;
+    tmp->length = (size_t)st.st_size;
+    if ((tmp->path = strdup(path)) == NULL) {
+        log_error("file_cache_load strdup() %s: %s", path, strerror(errno));
+        goto miss;
+    }
+    if (kind == FILE_CACHE_FD) {
+        tmp->fd = fd;
+    } else {
+        if ((tmp->data = malloc(tmp->length > 0 ? tmp->length : 1)) == NULL) {
+            log_error("file_cache_load malloc() %s: %s", path, strerror(errno));
+            goto miss;
+        }
+        if (read_file(fd, tmp->data, tmp->length) != EXIT_SUCCESS) {
+            goto miss;
+        }
+        close(fd);
+    }
+
+    tmp->shard = shard;
+    tmp->hash = hash;
+    tmp->content_type = content_type;
+    tmp->mtime = st.st_mtim;
+    tmp->inode = st.st_ino;
+    tmp->refs = 1;
+
+    pthread_mutex_lock(&shard->mutex);
+    if (shard->generation == generation && file_cache_enabled()) {
+        struct file_cache_entry *old = shard_find(shard, hash, path);
+        if (old != NULL) {
+            shard_unlink(shard, old);
+        }
+        shard_link(shard, tmp);
+        shard_evict(shard);
+    }
+    pthread_mutex_unlock(&shard->mutex);
+    *entry = tmp;
+
+    return EXIT_SUCCESS;
+
+miss:
+    if (tmp != NULL) {
+        tmp->fd = -1;
+        entry_free(tmp);
+    }
+    close(fd);
+    return FILE_CACHE_MISS;
+}
+
+int file_cache_entry_get_data(file_cache_entry_t entry, const char **data, size_t *length) {
+    *data = entry->data;
+    *length = entry->length;
+    return EXIT_SUCCESS;
+}
+
+int file_cache_entry_get_fd(file_cache_entry_t entry, int *fd) {
+    *fd = entry->fd;
+    return EXIT_SUCCESS;
+}
+
+int file_cache_entry_get_content_type(file_cache_entry_t entry, const char **content_type) {
+    *content_type = entry->content_type;
+    return EXIT_SUCCESS;
+}
+
+int file_cache_entry_get_mtime(file_cache_entry_t entry, struct timespec *mtime) {
+    *mtime = entry->mtime;
+    return EXIT_SUCCESS;
+}
+
+int file_cache_entry_get_inode(file_cache_entry_t entry, ino_t *inode) {
+    *inode = entry->inode;
+    return EXIT_SUCCESS;
+}
+
+void file_cache_release(file_cache_entry_t *entry) {
+    if (entry == NULL || *entry == NULL) {
+        return;
+    }
+    struct file_cache_shard *shard = (*entry)->shard;
+
+    pthread_mutex_lock(&shard->mutex);
+    bool unused = --(*entry)->refs == 0 && !(*entry)->linked;
+    pthread_mutex_unlock(&shard->mutex);
+
+    if (unused) {
+        entry_free(*entry);
+    }
+    *entry = NULL;
+}
+
+void file_cache_destroy(void) {
+    if (cache.watching) {
+        uint64_t stop = 1;
+        if (write(cache.stop_fd, &stop, sizeof(stop)) == sizeof(stop)) {
+            pthread_join(cache.watcher, NULL);
+        }
+        cache.watching = false;
+    }
+    __atomic_store_n(&cache.enabled, false, __ATOMIC_RELEASE);
+    if (cache.root != NULL) {
+        file_cache_flush();
+    }
+    if (cache.inotify_fd != -1) {
+        close(cache.inotify_fd);
+        cache.inotify_fd = -1;
+    }
+    if (cache.stop_fd != -1) {
+        close(cache.stop_fd);
+        cache.stop_fd = -1;
+    }
+    for (size_t i = 0; i < cache.watches_capacity; i++) {
+        free(cache.watches[i]);
+    }
+    free(cache.watches);
+    cache.watches = NULL;
+    cache.watches_capacity = 0;
+    free(cache.root);
+    cache.root = NULL;
+}
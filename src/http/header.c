@@ -5,30 +5,29 @@
 #include "log.h"
 
 struct http_header {
+    arena_t arena;
     char *name;
     char *value;
 };
 
-int http_header_create(http_header_t *header, const char *name, const char *value) {
-    http_header_t tmp_header = malloc(sizeof(struct http_header));
+int http_header_create(http_header_t *header, arena_t arena, const char *name, const char *value) {
+    http_header_t tmp_header = arena_alloc(arena, sizeof(struct http_header));
     if (tmp_header == NULL) {
-        log_error("http_header_create malloc() struct http_header: %s", strerror(errno));
+        log_error("http_header_create arena_alloc() struct http_header: %s", strerror(errno));
         return errno;
     }
 
-    tmp_header->name = strdup(name);
+    tmp_header->arena = arena;
+    tmp_header->name = arena_strdup(arena, name);
     if (tmp_header->name == NULL) {
-        log_error("http_header_create strdup() name: %s", strerror(errno));
-        free(tmp_header);
-        return EXIT_FAILURE;
+        log_error("http_header_create arena_strdup() name: %s", strerror(errno));
+        return errno;
     }
 
-    tmp_header->value = strdup(value);
+    tmp_header->value = arena_strdup(arena, value);
     if (tmp_header->value == NULL) {
-        log_error("http_header_create strdup() value: %s", strerror(errno));
-        free(tmp_header->name);
-        free(tmp_header);
-        return EXIT_FAILURE;
+        log_error("http_header_create arena_strdup() value: %s", strerror(errno));
+        return errno;
     }
 
     *header = tmp_header;
@@ -36,39 +35,35 @@ int http_header_create(http_header_t *header, const char *name, const char *valu
     return EXIT_SUCCESS;
 }
 
-int http_header_create_from_raw(http_header_t *header, const char *raw_header) {
-    char *raw = strdup(raw_header);
-    if (raw == NULL) {
-        log_error("http_header_create_from_raw strdup() raw_header: %s", strerror(errno));
-        return errno;
-    }
-
-    char *value = strstr(raw, ": ") + 2;
+int http_header_create_from_raw(http_header_t *header, arena_t arena, const char *raw_header) {
+    const char *value = strstr(raw_header, ": ");
     if (value == NULL) {
-        log_error("get invalid http header: '%s'", raw);
-        free(raw);
+        log_error("get invalid http header: '%s'", raw_header);
         return EXIT_FAILURE;
     }
-    if (value >= raw + strlen(raw)) {
-        log_error("http header hasn't any value: '%s'", raw);
-        free(raw);
+    if (value[2] == '\0') {
+        log_error("http header hasn't any value: '%s'", raw_header);
         return EXIT_FAILURE;
     }
-    *(value - 2) = '\0';
 
-    int rc = http_header_create(header, raw, value);
-    free(raw);
+    size_t name_len = (size_t)(value - raw_header);
+    char *name = arena_alloc(arena, name_len + 1);
+    if (name == NULL) {
+        log_error("http_header_create_from_raw arena_alloc() name: %s", strerror(errno));
+        return errno;
+    }
+    memcpy(name, raw_header, name_len);
+    name[name_len] = '\0';
 
-    return rc;
+    return http_header_create(header, arena, name, value + 2);
 }
 
 int http_header_set_name(http_header_t header, const char *name) {
-    char *tmp = strdup(name);
-    if (header->name == NULL) {
-        log_error("http_header_set_name strdup(): %s", strerror(errno));
+    char *tmp = arena_strdup(header->arena, name);
+    if (tmp == NULL) {
+        log_error("http_header_set_name arena_strdup(): %s", strerror(errno));
         return errno;
     }
-    free(header->name);
     header->name = tmp;
 
     return EXIT_SUCCESS;
@@ -80,12 +75,11 @@ int http_header_get_name(http_header_t header, char **name) {
 }
 
 int http_header_set_value(http_header_t header, const char *value) {
-    char *tmp = strdup(value);
-    if (header->name == NULL) {
-        log_error("http_header_set_value strdup(): %s", strerror(errno));
+    char *tmp = arena_strdup(header->arena, value);
+    if (tmp == NULL) {
+        log_error("http_header_set_value arena_strdup(): %s", strerror(errno));
         return errno;
     }
-    free(header->value);
     header->value = tmp;
 
     return EXIT_SUCCESS;
@@ -96,37 +90,10 @@ int http_header_get_value(http_header_t header, char **value) {
     return EXIT_SUCCESS;
 }
 
-int http_header_make_raw(http_header_t header, char **raw_header) {
-    char *raw = malloc(strlen(header->name) + strlen(header->value) + 3);
-    if (raw == NULL) {
-        log_error("http_header_make_raw malloc(): %s", strerror(errno));
-        return errno;
-    }
-
-    strcpy(raw, header->name);
-    strcpy(raw + strlen(header->name), ": ");
-    strcpy(raw + strlen(header->name) + 2, header->value);
-    raw[strlen(header->name) + strlen(header->value) + 2] = '\0';
-
-    *raw_header = raw;
-
-    return EXIT_SUCCESS;
-}
-
-void http_header_destroy_raw(char **raw_header) {
-    if (raw_header == NULL || *raw_header == NULL) {
-        return;
-    }
-    free(*raw_header);
-    *raw_header = NULL;
-}
-
+// The memory goes back with arena_reset(); only the handle is cleared.
 void http_header_destroy(http_header_t *header) {
-    if (header == NULL || *header == NULL) {
+    if (header == NULL) {
         return;
     }
-    free((*header)->name);
-    free((*header)->value);
-    free(*header);
     *header = NULL;
 }
@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <errno.h>
 #include "headers.h"
 #include "log.h"
@@ -7,25 +8,26 @@
 #define MEMORY_EXPANSION_RATE 1.25
 
 struct http_headers {
+    arena_t arena;
     http_header_t *headers;
     size_t size;
     size_t capacity;
 };
 
-int http_headers_create(http_headers_t *headers, const size_t capacity) {
-    http_header_t *tmp_headers = malloc(capacity * sizeof(http_header_t));
+int http_headers_create(http_headers_t *headers, arena_t arena, const size_t capacity) {
+    http_header_t *tmp_headers = arena_alloc(arena, capacity * sizeof(http_header_t));
     if (tmp_headers == NULL) {
-        log_error("http_headers_create malloc() headers: %s", strerror(errno));
+        log_error("http_headers_create arena_alloc() headers: %s", strerror(errno));
         return errno;
     }
 
-    http_headers_t tmp = malloc(sizeof(struct http_headers));
+    http_headers_t tmp = arena_alloc(arena, sizeof(struct http_headers));
     if (tmp == NULL) {
-        log_error("http_headers_create malloc() struct http_headers: %s", strerror(errno));
-        free(tmp_headers);
-        return EXIT_FAILURE;
+        log_error("http_headers_create arena_alloc() struct http_headers: %s", strerror(errno));
+        return errno;
     }
 
+    tmp->arena = arena;
     tmp->headers = tmp_headers;
     tmp->size = 0;
     tmp->capacity = capacity;
@@ -34,12 +36,14 @@ int http_headers_create(http_headers_t *headers, const size_t capacity) {
     return EXIT_SUCCESS;
 }
 
+// The old array is not freed: arena memory only goes back all at once.
 static int http_headers_set_capacity(http_headers_t headers, const size_t capacity) {
-    http_header_t *tmp = realloc(headers->headers, capacity * sizeof(http_header_t));
+    http_header_t *tmp = arena_alloc(headers->arena, capacity * sizeof(http_header_t));
     if (tmp == NULL) {
-        log_error("http_headers_set_capacity realloc() headers: %s", strerror(errno));
+        log_error("http_headers_set_capacity arena_alloc() headers: %s", strerror(errno));
         return errno;
     }
+    memcpy(tmp, headers->headers, headers->size * sizeof(http_header_t));
     headers->headers = tmp;
     headers->capacity = capacity;
 
@@ -65,7 +69,7 @@ int http_headers_append(http_headers_t headers, const http_header_t header) {
 
 int http_headers_set_header(http_headers_t headers, const char *name, const char *value) {
     http_header_t header = NULL;
-    int rc = http_header_create(&header, name, value);
+    int rc = http_header_create(&header, headers->arena, name, value);
     if (rc != EXIT_SUCCESS) {
         return rc;
     }
@@ -75,7 +79,7 @@ int http_headers_set_header(http_headers_t headers, const char *name, const char
 
 int http_headers_create_header(http_headers_t headers, const char *raw_header) {
     http_header_t header = NULL;
-    int rc = http_header_create_from_raw(&header, raw_header);
+    int rc = http_header_create_from_raw(&header, headers->arena, raw_header);
     if (rc != EXIT_SUCCESS) {
         return rc;
     }
@@ -83,8 +87,10 @@ int http_headers_create_header(http_headers_t headers, const char *raw_header) {
     return http_headers_append(headers, header);
 }
 
+// Shrinking would only copy the array within the arena, so the spare capacity is kept.
 int http_headers_compress(http_headers_t headers) {
-    return http_headers_set_capacity(headers, headers->size);
+    (void)headers;
+    return EXIT_SUCCESS;
 }
 
 int http_headers_find_header(http_headers_t headers, const char *name, char **value) {
@@ -95,7 +101,7 @@ int http_headers_find_header(http_headers_t headers, const char *name, char **va
         if (rc != EXIT_SUCCESS) {
             return rc;
         }
-        if (strcmp(name, cur_name) == 0) {
+        if (strcasecmp(name, cur_name) == 0) {
             char *cur_value = NULL;
             rc = http_header_get_value(headers->headers[i], &cur_value);
             if (rc != EXIT_SUCCESS) {
@@ -115,9 +121,6 @@ int http_headers_find_header(http_headers_t headers, const char *name, char **va
 
 int http_headers_truncate(http_headers_t headers, const size_t new_size) {
     if (new_size < headers->size) {
-        for (size_t i = new_size; i < headers->size; i++) {
-            http_header_destroy(&headers->headers[i]);
-        }
         headers->size = new_size;
     }
 
@@ -134,14 +137,10 @@ int http_headers_at(http_headers_t headers, const size_t index, http_header_t *h
     return EXIT_SUCCESS;
 }
 
+// The memory goes back with arena_reset(); only the handle is cleared.
 void http_headers_destroy(http_headers_t *headers) {
-    if (headers == NULL || *headers == NULL) {
+    if (headers == NULL) {
         return;
     }
-    for (size_t i = 0; i < (*headers)->size; i++) {
-        http_header_destroy(&(*headers)->headers[i]);
-    }
-    free((*headers)->headers);
-    free(*headers);
     *headers = NULL;
 }
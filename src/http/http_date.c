@@ -0,0 +1,30 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include "http_date.h"
+
+int http_date_parse(const char *value, time_t *date) {
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    const char *end = strptime(value, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if (end == NULL || *end != '\0') {
+        return INVALID_HTTP_DATE;
+    }
+
+    *date = timegm(&tm);
+    return EXIT_SUCCESS;
+}
+
+int http_date_format(time_t date, char *buf, size_t size) {
+    struct tm tm;
+    if (gmtime_r(&date, &tm) == NULL) {
+        return INVALID_HTTP_DATE;
+    }
+    if (strftime(buf, size, "%a, %d %b %Y %H:%M:%S GMT", &tm) == 0) {
+        return ENOBUFS;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,91 @@
+#include <strings.h>
+#include "known_headers.h"
+
+#define MATCH(literal, header) \
+    return strncasecmp(name, literal, length) == 0 ? (header) : HTTP_HEADER_UNKNOWN
+
+static char lower(char c) {
+    return (char)(c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c);
+}
+
+http_known_header_t http_known_header_of(const char *name, size_t length) {
+    switch (length) {
+        case 4:
+            MATCH("host", HTTP_HEADER_HOST);
+        case 5:
+            MATCH("range", HTTP_HEADER_RANGE);
+        case 6:
+            switch (lower(name[0])) {
+                case 'a':
+                    MATCH("accept", HTTP_HEADER_ACCEPT);
+                case 'c':
+                    MATCH("cookie", HTTP_HEADER_COOKIE);
+                case 'e':
+                    MATCH("expect", HTTP_HEADER_EXPECT);
+                default:
+                    return HTTP_HEADER_UNKNOWN;
+            }
+        case 7:
+            switch (lower(name[0])) {
+                case 'r':
+                    MATCH("referer", HTTP_HEADER_REFERER);
+                case 'u':
+                    MATCH("upgrade", HTTP_HEADER_UPGRADE);
+                default:
+                    return HTTP_HEADER_UNKNOWN;
+            }
+        case 8:
+            switch (lower(name[3])) {
+                case 'r':
+                    MATCH("if-range", HTTP_HEADER_IF_RANGE);
+                case 'm':
+                    MATCH("if-match", HTTP_HEADER_IF_MATCH);
+                default:
+                    return HTTP_HEADER_UNKNOWN;
+            }
+        case 10:
+            switch (lower(name[0])) {
+                case 'c':
+                    MATCH("connection", HTTP_HEADER_CONNECTION);
+                case 'u':
+                    MATCH("user-agent", HTTP_HEADER_USER_AGENT);
+                default:
+                    return HTTP_HEADER_UNKNOWN;
+            }
+        case 13:
+            switch (lower(name[0])) {
+                case 'i':
+                    MATCH("if-none-match", HTTP_HEADER_IF_NONE_MATCH);
+                case 'a':
+                    MATCH("authorization", HTTP_HEADER_AUTHORIZATION);
+                case 'c':
+                    MATCH("cache-control", HTTP_HEADER_CACHE_CONTROL);
+                default:
+                    return HTTP_HEADER_UNKNOWN;
+            }
+        case 14:
+            MATCH("content-length", HTTP_HEADER_CONTENT_LENGTH);
+        case 15:
+            switch (lower(name[7])) {
+                case 'e':
+                    MATCH("accept-encoding", HTTP_HEADER_ACCEPT_ENCODING);
+                case 'l':
+                    MATCH("accept-language", HTTP_HEADER_ACCEPT_LANGUAGE);
+                default:
+                    return HTTP_HEADER_UNKNOWN;
+            }
+        case 17:
+            switch (lower(name[0])) {
+                case 't':
+                    MATCH("transfer-encoding", HTTP_HEADER_TRANSFER_ENCODING);
+                case 'i':
+                    MATCH("if-modified-since", HTTP_HEADER_IF_MODIFIED_SINCE);
+                default:
+                    return HTTP_HEADER_UNKNOWN;
+            }
+        case 19:
+            MATCH("if-unmodified-since", HTTP_HEADER_IF_UNMODIFIED_SINCE);
+        default:
+            return HTTP_HEADER_UNKNOWN;
+    }
+}
@@ -0,0 +1,384 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include "mime_types.h"
+#include "log.h"
+
+#define MIME_TYPES_LINE_MAX 1024
+#define MIME_TYPES_MAX_ATTEMPTS (1 << 16)
+#define MIME_TYPES_KEYS_PER_BUCKET 4
+
+// Used as is when there is no mime.types file, e.g. in a scratch container.
+static const char *builtin_types[] = {
+    "text/html html htm shtml",
+    "text/css css",
+    "text/javascript js mjs",
+    "text/plain txt text log",
+    "text/csv csv",
+    "text/markdown md markdown",
+    "text/xml xml",
+    "text/calendar ics",
+    "application/json json map",
+    "application/ld+json jsonld",
+    "application/manifest+json webmanifest",
+    "application/atom+xml atom",
+    "application/rss+xml rss",
+    "application/wasm wasm",
+    "application/pdf pdf",
+    "application/zip zip",
+    "application/gzip gz",
+    "application/x-tar tar",
+    "image/png png",
+    "image/jpeg jpeg jpg jpe",
+    "image/gif gif",
+    "image/svg+xml svg svgz",
+    "image/webp webp",
+    "image/avif avif",
+    "image/x-icon ico",
+    "image/bmp bmp",
+    "image/tiff tif tiff",
+    "font/woff woff",
+    "font/woff2 woff2",
+    "font/ttf ttf",
+    "font/otf otf",
+    "application/vnd.ms-fontobject eot",
+    "audio/mpeg mp3",
+    "audio/ogg ogg oga",
+    "audio/mp4 m4a",
+    "audio/wav wav",
+    "video/mp4 mp4 m4v",
+    "video/webm webm",
+    "video/ogg ogv",
+    "video/quicktime mov",
+    "video/mpeg mpeg mpg",
+    "application/x-shockwave-flash swf",
+};
+
+#define BUILTIN_TYPES_COUNT (sizeof(builtin_types) / sizeof(builtin_types[0]))
+
+typedef struct mime_entry {
+    char *extension;
+    const char *type;
+} mime_entry_t;
+
+// Extensions are found with a hash-and-displace perfect hash: the first hash picks a bucket, whose displacement
+// sends every key of the bucket to a slot of its own, so a lookup is two hashes of the extension and one strcmp.
+struct mime_types {
+    mime_entry_t *entries;
+    size_t entries_count;
+    size_t entries_capacity;
+    char **types;                   // owned Content-Type strings, one per mime.types line
+    size_t types_count;
+    size_t types_capacity;
+    uint32_t *displacements;
+    size_t buckets_count;
+    int32_t *slots;                 // index into entries, or -1
+    size_t slots_count;
+    char *default_type;
+};
+
+static struct mime_types mime_types;
+
+static uint32_t hash_extension(const char *extension, uint32_t seed) {
+    uint32_t hash = 2166136261u ^ (seed * 16777619u);
+    for (const unsigned char *p = (const unsigned char *)extension; *p != '\0'; p++) {
+        hash ^= *p;
+        hash *= 16777619u;
+    }
+    hash ^= hash >> 15;
+    hash *= 0x2c1b3c6du;
+    hash ^= hash >> 12;
+
+    return hash;
+}
+
+static bool is_textual(const char *type) {
+    return strncmp(type, "text/", 5) == 0 || strcmp(type, "application/javascript") == 0 ||
+           strcmp(type, "application/json") == 0 || strcmp(type, "application/xml") == 0 ||
+           strcmp(type, "application/manifest+json") == 0 || strcmp(type, "application/ld+json") == 0 ||
+           strcmp(type, "application/atom+xml") == 0 || strcmp(type, "application/rss+xml") == 0 ||
+           strcmp(type, "image/svg+xml") == 0;
+}
+
+static char *add_type(const char *type, const char *charset) {
+    if (mime_types.types_count == mime_types.types_capacity) {
+        size_t capacity = mime_types.types_capacity > 0 ? mime_types.types_capacity * 2 : 256;
+        char **types = realloc(mime_types.types, capacity * sizeof(char *));
+        if (types == NULL) {
+            log_error("add_type realloc(): %s", strerror(errno));
+            return NULL;
+        }
+        mime_types.types = types;
+        mime_types.types_capacity = capacity;
+    }
+
+    char *tmp = NULL;
+    if (charset != NULL && is_textual(type)) {
+        size_t length = strlen(type) + strlen("; charset=") + strlen(charset) + 1;
+        if ((tmp = malloc(length)) != NULL) {
+            snprintf(tmp, length, "%s; charset=%s", type, charset);
+        }
+    } else {
+        tmp = strdup(type);
+    }
+    if (tmp == NULL) {
+        log_error("add_type malloc(): %s", strerror(errno));
+        return NULL;
+    }
+    mime_types.types[mime_types.types_count++] = tmp;
+
+    return tmp;
+}
+
+// A later line wins, so mime.types overrides the built-in list.
+static int add_extension(const char *extension, const char *type) {
+    for (size_t i = 0; i < mime_types.entries_count; i++) {
+        if (strcmp(mime_types.entries[i].extension, extension) == 0) {
+            mime_types.entries[i].type = type;
+            return EXIT_SUCCESS;
+        }
+    }
+
+    if (mime_types.entries_count == mime_types.entries_capacity) {
+        size_t capacity = mime_types.entries_capacity > 0 ? mime_types.entries_capacity * 2 : 256;
+        mime_entry_t *entries = realloc(mime_types.entries, capacity * sizeof(mime_entry_t));
+        if (entries == NULL) {
+            log_error("add_extension realloc(): %s", strerror(errno));
+            return errno;
+        }
+        mime_types.entries = entries;
+        mime_types.entries_capacity = capacity;
+    }
+
+    char *tmp = strdup(extension);
+    if (tmp == NULL) {
+        log_error("add_extension strdup(): %s", strerror(errno));
+        return errno;
+    }
+    mime_types.entries[mime_types.entries_count].extension = tmp;
+    mime_types.entries[mime_types.entries_count].type = type;
+    mime_types.entries_count++;
+
+    return EXIT_SUCCESS;
+}
+
+// Parses "type ext1 ext2 ..."; comments, blank lines, types without extensions and overlong extensions are skipped.
+static int parse_line(char *line, const char *charset) {
+    char *comment = strchr(line, '#');
+    if (comment != NULL) {
+        *comment = '\0';
+    }
+
+    char *save = NULL;
+    char *type = strtok_r(line, " \t\r\n", &save);
+    if (type == NULL || strchr(type, '/') == NULL) {
+        return EXIT_SUCCESS;
+    }
+
+    const char *owned = NULL;
+    for (char *extension = strtok_r(NULL, " \t\r\n", &save); extension != NULL;
+         extension = strtok_r(NULL, " \t\r\n", &save)) {
+        if (strlen(extension) >= MIME_EXTENSION_MAX) {
+            continue;
+        }
+        for (char *p = extension; *p != '\0'; p++) {
+            *p = (char)tolower((unsigned char)*p);
+        }
+        if (owned == NULL && (owned = add_type(type, charset)) == NULL) {
+            return ENOMEM;
+        }
+        int rc = add_extension(extension, owned);
+        if (rc != EXIT_SUCCESS) {
+            return rc;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static int load_file(const char *path, const char *charset) {
+    FILE *file = fopen(path, "re");
+    if (file == NULL) {
+        if (errno != ENOENT) {
+            log_warn("open mime types %s: %s", path, strerror(errno));
+        }
+        return EXIT_SUCCESS;
+    }
+
+    int rc = EXIT_SUCCESS;
+    char line[MIME_TYPES_LINE_MAX];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if ((rc = parse_line(line, charset)) != EXIT_SUCCESS) {
+            break;
+        }
+    }
+    fclose(file);
+
+    return rc;
+}
+
+typedef struct {
+    size_t bucket;
+    size_t size;
+} bucket_size_t;
+
+static int compare_bucket_sizes(const void *a, const void *b) {
+    const bucket_size_t *left = a, *right = b;
+    return left->size < right->size ? 1 : left->size > right->size ? -1 : 0;
+}
+
+// Places the largest buckets first, while most slots are still free, trying displacements until each bucket fits.
+static int place_buckets(size_t *bucket_of_entry, bucket_size_t *order, size_t *keys) {
+    size_t n = mime_types.entries_count;
+    for (size_t i = 0; i < mime_types.slots_count; i++) {
+        mime_types.slots[i] = -1;
+    }
+
+    for (size_t b = 0; b < mime_types.buckets_count && order[b].size > 0; b++) {
+        size_t bucket = order[b].bucket;
+        size_t count = 0;
+        for (size_t i = 0; i < n; i++) {
+            if (bucket_of_entry[i] == bucket) {
+                keys[count++] = i;
+            }
+        }
+
+        bool placed = false;
+        for (uint32_t d = 1; d < MIME_TYPES_MAX_ATTEMPTS && !placed; d++) {
+            placed = true;
+            for (size_t k = 0; k < count && placed; k++) {
+                size_t slot = hash_extension(mime_types.entries[keys[k]].extension, d) % mime_types.slots_count;
+                if (mime_types.slots[slot] != -1) {
+                    placed = false;
+                    break;
+                }
+                mime_types.slots[slot] = (int32_t)keys[k];
+            }
+            if (!placed) {
+                for (size_t i = 0; i < mime_types.slots_count; i++) {
+                    if (mime_types.slots[i] != -1 && bucket_of_entry[mime_types.slots[i]] == bucket) {
+                        mime_types.slots[i] = -1;
+                    }
+                }
+                continue;
+            }
+            mime_types.displacements[bucket] = d;
+        }
+        if (!placed) {
+            return EAGAIN;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static int build_perfect_hash(void) {
+    size_t n = mime_types.entries_count;
+    mime_types.buckets_count = n / MIME_TYPES_KEYS_PER_BUCKET + 1;
+    mime_types.slots_count = n + n / 4 + 1;
+
+    int rc = ENOMEM;
+    size_t *bucket_of_entry = malloc((n + 1) * sizeof(size_t));
+    size_t *keys = malloc((n + 1) * sizeof(size_t));
+    bucket_size_t *order = calloc(mime_types.buckets_count, sizeof(bucket_size_t));
+    mime_types.displacements = calloc(mime_types.buckets_count, sizeof(uint32_t));
+    if (bucket_of_entry == NULL || keys == NULL || order == NULL || mime_types.displacements == NULL) {
+        log_error("build_perfect_hash calloc(): %s", strerror(errno));
+        goto exit;
+    }
+
+    for (size_t b = 0; b < mime_types.buckets_count; b++) {
+        order[b].bucket = b;
+    }
+    for (size_t i = 0; i < n; i++) {
+        bucket_of_entry[i] = hash_extension(mime_types.entries[i].extension, 0) % mime_types.buckets_count;
+        order[bucket_of_entry[i]].size++;
+    }
+    qsort(order, mime_types.buckets_count, sizeof(bucket_size_t), compare_bucket_sizes);
+
+    // A denser table may leave a large bucket without a displacement that fits; more slots always get there.
+    while (true) {
+        int32_t *slots = realloc(mime_types.slots, mime_types.slots_count * sizeof(int32_t));
+        if (slots == NULL) {
+            log_error("build_perfect_hash realloc(): %s", strerror(errno));
+            goto exit;
+        }
+        mime_types.slots = slots;
+        if ((rc = place_buckets(bucket_of_entry, order, keys)) != EAGAIN) {
+            break;
+        }
+        mime_types.slots_count *= 2;
+    }
+
+exit:
+    free(bucket_of_entry);
+    free(keys);
+    free(order);
+    return rc;
+}
+
+int mime_types_init(const char *path, const char *default_type, const char *charset) {
+    int rc;
+    for (size_t i = 0; i < BUILTIN_TYPES_COUNT; i++) {
+        char line[MIME_TYPES_LINE_MAX];
+        snprintf(line, sizeof(line), "%s", builtin_types[i]);
+        if ((rc = parse_line(line, charset)) != EXIT_SUCCESS) {
+            return rc;
+        }
+    }
+    if (path != NULL && (rc = load_file(path, charset)) != EXIT_SUCCESS) {
+        return rc;
+    }
+    if ((mime_types.default_type = add_type(default_type, charset)) == NULL) {
+        return ENOMEM;
+    }
+    if ((rc = build_perfect_hash()) != EXIT_SUCCESS) {
+        return rc;
+    }
+    log_info("mime types: %lu extensions in %lu slots, default %s", mime_types.entries_count,
+             mime_types.slots_count, mime_types.default_type);
+
+    return EXIT_SUCCESS;
+}
+
+const char *mime_type_of(const char *path) {
+    const char *dot = strrchr(path, '.');
+    if (dot == NULL || strchr(dot, '/') != NULL || mime_types.slots == NULL) {
+        return mime_types.default_type;
+    }
+
+    char extension[MIME_EXTENSION_MAX];
+    size_t length = 0;
+    for (const char *p = dot + 1; *p != '\0'; p++) {
+        if (length + 1 == MIME_EXTENSION_MAX) {
+            return mime_types.default_type;
+        }
+        extension[length++] = (char)tolower((unsigned char)*p);
+    }
+    extension[length] = '\0';
+
+    uint32_t displacement = mime_types.displacements[hash_extension(extension, 0) % mime_types.buckets_count];
+    int32_t index = mime_types.slots[hash_extension(extension, displacement) % mime_types.slots_count];
+    if (index == -1 || strcmp(mime_types.entries[index].extension, extension) != 0) {
+        return mime_types.default_type;
+    }
+
+    return mime_types.entries[index].type;
+}
+
+void mime_types_destroy(void) {
+    for (size_t i = 0; i < mime_types.entries_count; i++) {
+        free(mime_types.entries[i].extension);
+    }
+    for (size_t i = 0; i < mime_types.types_count; i++) {
+        free(mime_types.types[i]);
+    }
+    free(mime_types.entries);
+    free(mime_types.types);
+    free(mime_types.displacements);
+    free(mime_types.slots);
+    memset(&mime_types, 0, sizeof(mime_types));
+}
@@ -0,0 +1,182 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include "parser.h"
+#include "scanner.h"
+
+static bool is_token_char(char c) {
+    // RFC 9110 tchar
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+           c == '!' || c == '#' || c == '$' || c == '%' || c == '&' || c == '\'' || c == '*' ||
+           c == '+' || c == '-' || c == '.' || c == '^' || c == '_' || c == '`' || c == '|' || c == '~';
+}
+
+static bool is_ctl(char c) {
+    return (unsigned char)c < 0x20 || c == 0x7f;
+}
+
+static http_slice_t make_slice(uint32_t start, uint32_t end) {
+    http_slice_t slice = {
+        .offset = start,
+        .length = end - start,
+    };
+    return slice;
+}
+
+void http_parser_reset(http_parser_t *parser) {
+    parser->state = HTTP_PARSER_METHOD;
+    parser->position = 0;
+    parser->mark = 0;
+    parser->value_end = 0;
+    parser->headers_count = 0;
+    memset(parser->known_headers, 0, sizeof(parser->known_headers));
+    memset(parser->unknown_headers, 0, sizeof(parser->unknown_headers));
+}
+
+// Later headers with the same name are left out of the index: lookups return the first one.
+static void index_header_name(http_parser_t *parser, const char *data, http_slice_t name) {
+    uint8_t slot = (uint8_t)(parser->headers_count + 1);
+    http_known_header_t known = http_known_header_of(data + name.offset, name.length);
+    if (known != HTTP_HEADER_UNKNOWN) {
+        if (parser->known_headers[known] == 0) {
+            parser->known_headers[known] = slot;
+        }
+        return;
+    }
+
+    for (uint32_t i = parser->name_hash;; i++) {
+        uint8_t *entry = &parser->unknown_headers[i & (HTTP_UNKNOWN_HEADER_SLOTS - 1)];
+        if (*entry == 0) {
+            *entry = slot;
+            return;
+        }
+        http_slice_t other = parser->header_names[*entry - 1];
+        if (other.length == name.length && strncasecmp(data + other.offset, data + name.offset, name.length) == 0) {
+            return;
+        }
+    }
+}
+
+int http_parser_execute(http_parser_t *parser, char *data, size_t length) {
+    if (length > HTTP_MAX_REQUEST_HEAD_SIZE) {
+        length = HTTP_MAX_REQUEST_HEAD_SIZE;
+    }
+
+    uint32_t i = parser->position;
+    for (; i < length; i++) {
+        char c = data[i];
+        switch (parser->state) {
+            case HTTP_PARSER_METHOD:
+                if (c == ' ' && i > parser->mark) {
+                    parser->method = make_slice(parser->mark, i);
+                    data[i] = '\0';
+                    parser->mark = i + 1;
+                    parser->state = HTTP_PARSER_PATH;
+                } else if (!is_token_char(c)) {
+                    return HTTP_PARSER_INVALID;
+                }
+                break;
+            case HTTP_PARSER_PATH:
+                if (c == ' ' && i > parser->mark) {
+                    parser->path = make_slice(parser->mark, i);
+                    data[i] = '\0';
+                    parser->mark = i + 1;
+                    parser->state = HTTP_PARSER_PROTO;
+                } else if (c == ' ' || is_ctl(c)) {
+                    return HTTP_PARSER_INVALID;
+                } else {
+                    i = http_scan_delimiter(data, i + 1, (uint32_t)length, HTTP_SCAN_CTL_OR_SPACE) - 1;
+                }
+                break;
+            case HTTP_PARSER_PROTO:
+                if ((c == '\r' || c == '\n') && i > parser->mark) {
+                    parser->proto = make_slice(parser->mark, i);
+                    data[i] = '\0';
+                    parser->state = c == '\r' ? HTTP_PARSER_PROTO_LF : HTTP_PARSER_HEADER_START;
+                } else if (c == ' ' || is_ctl(c)) {
+                    return HTTP_PARSER_INVALID;
+                }
+                break;
+            case HTTP_PARSER_PROTO_LF:
+            case HTTP_PARSER_HEADER_LF:
+                if (c != '\n') {
+                    return HTTP_PARSER_INVALID;
+                }
+                parser->state = HTTP_PARSER_HEADER_START;
+                break;
+            case HTTP_PARSER_HEADER_START:
+                if (c == '\r') {
+                    parser->state = HTTP_PARSER_END_LF;
+                } else if (c == '\n') {
+                    parser->position = i + 1;
+                    return HTTP_PARSER_DONE;
+                } else if (is_token_char(c)) {
+                    if (parser->headers_count == HTTP_MAX_HEADERS) {
+                        return HTTP_PARSER_TOO_LARGE;
+                    }
+                    parser->mark = i;
+                    parser->name_hash = http_header_hash_step(HTTP_HEADER_HASH_SEED, c);
+                    parser->state = HTTP_PARSER_HEADER_NAME;
+                } else {
+                    // Obsolete line folding and garbage alike.
+                    return HTTP_PARSER_INVALID;
+                }
+                break;
+            case HTTP_PARSER_HEADER_NAME:
+                if (c == ':') {
+                    parser->header_names[parser->headers_count] = make_slice(parser->mark, i);
+                    data[i] = '\0';
+                    index_header_name(parser, data, parser->header_names[parser->headers_count]);
+                    parser->state = HTTP_PARSER_HEADER_VALUE_START;
+                } else if (is_token_char(c)) {
+                    parser->name_hash = http_header_hash_step(parser->name_hash, c);
+                } else {
+                    return HTTP_PARSER_INVALID;
+                }
+                break;
+            case HTTP_PARSER_HEADER_VALUE_START:
+                if (c == ' ' || c == '\t') {
+                    break;
+                }
+                parser->mark = i;
+                parser->value_end = i;
+                parser->state = HTTP_PARSER_HEADER_VALUE;
+                // fallthrough
+            case HTTP_PARSER_HEADER_VALUE:
+                if (c == '\r' || c == '\n') {
+                    parser->header_values[parser->headers_count++] = make_slice(parser->mark, parser->value_end);
+                    data[parser->value_end] = '\0';
+                    parser->state = c == '\r' ? HTTP_PARSER_HEADER_LF : HTTP_PARSER_HEADER_START;
+                } else if (c == ' ' || c == '\t') {
+                    // Trailing whitespace is not part of the value; value_end stays at the last visible char.
+                } else if (is_ctl(c)) {
+                    return HTTP_PARSER_INVALID;
+                } else {
+                    // The rest of a run of visible characters and spaces is skipped in bulk; only where its last
+                    // visible character ends matters.
+                    uint32_t stop = http_scan_delimiter(data, i + 1, (uint32_t)length, HTTP_SCAN_CTL);
+                    uint32_t end = stop;
+                    while (end > i + 1 && data[end - 1] == ' ') {
+                        end--;
+                    }
+                    parser->value_end = end;
+                    i = stop - 1;
+                }
+                break;
+            case HTTP_PARSER_END_LF:
+                if (c != '\n') {
+                    return HTTP_PARSER_INVALID;
+                }
+                parser->position = i + 1;
+                return HTTP_PARSER_DONE;
+        }
+    }
+
+    parser->position = i;
+    if (parser->position >= HTTP_MAX_REQUEST_HEAD_SIZE) {
+        return HTTP_PARSER_TOO_LARGE;
+    }
+
+    return HTTP_PARSER_AGAIN;
+}
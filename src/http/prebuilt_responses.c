@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include "prebuilt_responses.h"
+#include "log.h"
+
+static http_prebuilt_response_t prebuilt_responses[] = {
+    { .status_code = HTTP_BAD_REQUEST },
+    { .status_code = HTTP_FORBIDDEN },
+    { .status_code = HTTP_NOT_FOUND },
+    { .status_code = HTTP_METHOD_NOT_ALLOWED },
+    { .status_code = HTTP_HEADERS_TOO_LARGE },
+    { .status_code = HTTP_INTERNAL_SERVER_ERROR },
+    { .status_code = HTTP_NOT_IMPLEMENTED },
+};
+
+#define PREBUILT_RESPONSES_COUNT (sizeof(prebuilt_responses) / sizeof(prebuilt_responses[0]))
+
+static int default_error_page(http_status_code_t status_code, char **page, size_t *length) {
+    const char *format = "<html>\n<head><title>%s</title></head>\n<body>\n<h1>%s</h1>\n</body>\n</html>\n";
+    int n = snprintf(NULL, 0, format, status_code, status_code);
+    char *tmp = malloc((size_t)n + 1);
+    if (tmp == NULL) {
+        log_error("default_error_page malloc(): %s", strerror(errno));
+        return errno;
+    }
+    snprintf(tmp, (size_t)n + 1, format, status_code, status_code);
+
+    *page = tmp;
+    *length = (size_t)n;
+
+    return EXIT_SUCCESS;
+}
+
+// Reads <dir>/<code>.html; ENOENT tells the caller to use the built-in page.
+static int load_error_page(const char *dir, http_status_code_t status_code, char **page, size_t *length) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%.3s.html", dir, status_code);
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        if (errno != ENOENT) {
+            log_warn("open error page %s: %s", path, strerror(errno));
+        }
+        return errno;
+    }
+
+    int rc = EXIT_SUCCESS;
+    char *tmp = NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        rc = errno;
+        log_warn("stat error page %s: %s", path, strerror(rc));
+        goto close;
+    }
+    if (!S_ISREG(st.st_mode) || st.st_size > ERROR_PAGE_MAX_SIZE) {
+        log_warn("error page %s is not a regular file of at most %d bytes", path, ERROR_PAGE_MAX_SIZE);
+        rc = EINVAL;
+        goto close;
+    }
+
+    size_t size = (size_t)st.st_size;
+    if ((tmp = malloc(size + 1)) == NULL) {
+        rc = errno;
+        log_error("load_error_page malloc(): %s", strerror(rc));
+        goto close;
+    }
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = read(fd, tmp + done, size - done);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            rc = n == 0 ? EIO : errno;
+            log_warn("read error page %s: %s", path, strerror(rc));
+            free(tmp);
+            goto close;
+        }
+        done += (size_t)n;
+    }
+    tmp[size] = '\0';
+    *page = tmp;
+    *length = size;
+
+close:
+    close(fd);
+    return rc;
+}
+
+static int prebuild_response(http_prebuilt_response_t *prebuilt, const char *body, size_t body_length) {
+    const char *format = HTTP_1_1 " %s\r\n"
+                         "Content-Type: text/html\r\n"
+                         "Content-Length: %zu\r\n"
+                         "Connection: %s\r\n"
+                         "\r\n";
+    for (int keep_alive = 0; keep_alive <= 1; keep_alive++) {
+        const char *connection = keep_alive ? "keep-alive" : "close";
+        int head_length = snprintf(NULL, 0, format, prebuilt->status_code, body_length, connection);
+        char *raw = malloc((size_t)head_length + body_length + 1);
+        if (raw == NULL) {
+            log_error("prebuild_response malloc(): %s", strerror(errno));
+            return errno;
+        }
+        snprintf(raw, (size_t)head_length + 1, format, prebuilt->status_code, body_length, connection);
+        memcpy(raw + head_length, body, body_length);
+
+        prebuilt->raw[keep_alive] = raw;
+        prebuilt->head_length[keep_alive] = (size_t)head_length;
+    }
+    prebuilt->body_length = body_length;
+
+    return EXIT_SUCCESS;
+}
+
+int http_prebuilt_responses_init(const char *error_pages_dir) {
+    for (size_t i = 0; i < PREBUILT_RESPONSES_COUNT; i++) {
+        http_prebuilt_response_t *prebuilt = &prebuilt_responses[i];
+        char *body = NULL;
+        size_t body_length = 0;
+
+        int rc = ENOENT;
+        if (error_pages_dir != NULL) {
+            rc = load_error_page(error_pages_dir, prebuilt->status_code, &body, &body_length);
+        }
+        if (rc != EXIT_SUCCESS && (rc = default_error_page(prebuilt->status_code, &body, &body_length)) != EXIT_SUCCESS) {
+            http_prebuilt_responses_destroy();
+            return rc;
+        }
+
+        rc = prebuild_response(prebuilt, body, body_length);
+        free(body);
+        if (rc != EXIT_SUCCESS) {
+            http_prebuilt_responses_destroy();
+            return rc;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+const http_prebuilt_response_t *http_prebuilt_response_find(http_status_code_t status_code) {
+    for (size_t i = 0; i < PREBUILT_RESPONSES_COUNT; i++) {
+        if (strcmp(prebuilt_responses[i].status_code, status_code) == 0) {
+            return prebuilt_responses[i].raw[0] != NULL ? &prebuilt_responses[i] : NULL;
+        }
+    }
+
+    return NULL;
+}
+
+void http_prebuilt_responses_destroy(void) {
+    for (size_t i = 0; i < PREBUILT_RESPONSES_COUNT; i++) {
+        free(prebuilt_responses[i].raw[0]);
+        free(prebuilt_responses[i].raw[1]);
+        prebuilt_responses[i].raw[0] = NULL;
+        prebuilt_responses[i].raw[1] = NULL;
+    }
+}
@@ -0,0 +1,100 @@
+#include <stdbool.h>
+#include <strings.h>
+#include <limits.h>
+#include "range.h"
+
+static const char *skip_spaces(const char *p) {
+    while (*p == ' ' || *p == '\t') {
+        p++;
+    }
+
+    return p;
+}
+
+// Reads a run of digits, saturating instead of overflowing: a huge last-byte-pos just means "to the end".
+static const char *parse_position(const char *p, unsigned long long *position) {
+    if (*p < '0' || *p > '9') {
+        return NULL;
+    }
+
+    unsigned long long value = 0;
+    for (; *p >= '0' && *p <= '9'; p++) {
+        unsigned digit = (unsigned)(*p - '0');
+        value = value > (ULLONG_MAX - digit) / 10 ? ULLONG_MAX : value * 10 + digit;
+    }
+    *position = value;
+
+    return p;
+}
+
+int http_range_parse(const char *value, size_t length, http_range_t *ranges, size_t capacity, size_t *count) {
+    const char *p = skip_spaces(value);
+    if (strncasecmp(p, "bytes", 5) != 0) {
+        return HTTP_RANGE_IGNORED;
+    }
+    p = skip_spaces(p + 5);
+    if (*p++ != '=') {
+        return HTTP_RANGE_IGNORED;
+    }
+
+    size_t specs = 0;
+    size_t n = 0;
+    while (true) {
+        while (*p == ' ' || *p == '\t' || *p == ',') {
+            p++;
+        }
+        if (*p == '\0') {
+            break;
+        }
+        if (++specs > capacity) {
+            return HTTP_RANGE_IGNORED;
+        }
+
+        unsigned long long first = 0, last = ULLONG_MAX;
+        if (*p == '-') {
+            unsigned long long suffix = 0;
+            if ((p = parse_position(p + 1, &suffix)) == NULL) {
+                return HTTP_RANGE_IGNORED;
+            }
+            if (suffix == 0) {
+                goto next;
+            }
+            first = suffix < length ? length - suffix : 0;
+        } else {
+            if ((p = parse_position(p, &first)) == NULL || *p++ != '-') {
+                return HTTP_RANGE_IGNORED;
+            }
+            if (*p >= '0' && *p <= '9') {
+                p = parse_position(p, &last);
+                if (last < first) {
+                    return HTTP_RANGE_IGNORED;
+                }
+            }
+        }
+
+        if (first < length) {
+            if (last >= length) {
+                last = length - 1;
+            }
+            ranges[n].offset = (off_t)first;
+            ranges[n].length = (size_t)(last - first + 1);
+            n++;
+        }
+
+    next:
+        p = skip_spaces(p);
+        if (*p != ',' && *p != '\0') {
+            return HTTP_RANGE_IGNORED;
+        }
+    }
+
+    if (specs == 0) {
+        return HTTP_RANGE_IGNORED;
+    }
+    if (n == 0) {
+        return HTTP_RANGE_UNSATISFIABLE;
+    }
+    *count = n;
+
+    return EXIT_SUCCESS;
+}
@@ -1,68 +1,23 @@
 #include <string.h>
+#include <strings.h>
 #include <stdbool.h>
 #include <time.h>
 #include <errno.h>
 #include "request.h"
-#include "headers.h"
 #include "log.h"
 
+// Views into the connection buffer the request was parsed from; nothing is copied.
 struct http_request {
     http_method_t method;
-    char *path;
-    http_proto_t proto;
-    http_headers_t headers;
-    char *body;
+    char *raw;
+    http_parser_t head;
     clock_t start_time;
 };
 
-static size_t substrings_count(const char *str, const char *substr){
-    size_t count = 0;
-    while((str = strstr(str, substr)) != NULL) {
-        count++;
-        str++;
-    }
-
-    return count;
-}
-
-static int http_request_parse_lines(const char *raw_request, char ***lines, size_t *n) {
-    char *raw = strdup(raw_request);
-    if (raw == NULL) {
-        log_error("http_request_parse_lines strdup() raw_request: %s", strerror(errno));
-        return errno;
-    }
-
-    size_t max_lines_count = substrings_count(raw, "\r\n") + 1;
-    char **tokens = malloc(max_lines_count * sizeof(char*));
-    if (tokens == NULL) {
-        log_error("http_request_parse_lines malloc() lines: %s", strerror(errno));
-        return errno;
-    }
-    char *token = strtok(raw, "\r\n");
-    size_t tokens_count = 0;
-
-    while (token != NULL) {
-        tokens[tokens_count++] = strdup(token);
-        token = strtok(NULL, "\r\n");
-    }
-
-    free(raw);
-    *lines = tokens;
-    *n = tokens_count;
-
-    return EXIT_SUCCESS;
-}
-
-static void http_request_free_lines(char **lines, size_t n) {
-    for (size_t i = 0; i < n; i++) {
-        free(lines[i]);
-    }
-    free(lines);
-}
-
-static http_method_t http_request_parse_method(const char *method) {
-    for (int i = GET; i < PATCH; i++) {
-        if (strcmp(method, http_method_mapping(i)) == 0) {
+static http_method_t http_request_parse_method(const char *method, size_t len) {
+    for (int i = GET; i <= PATCH; i++) {
+        const char *candidate = http_method_mapping(i);
+        if (strlen(candidate) == len && memcmp(method, candidate, len) == 0) {
             return i;
         }
     }
@@ -71,126 +26,30 @@ static http_method_t http_request_parse_method(const char *method) {
     return UNKNOWN_HTTP_METHOD;
 }
 
-static int http_request_parse_first_line(http_request_t request, char *line) {
-    char *start = line, *end = strstr(line, " ");
-    if (end == NULL) {
-        log_error("request first line is invalid");
-        return INVALID_HTTP_REQUEST;
-    }
-    *end = '\0';
-    request->method = http_request_parse_method(start);
-    *end = ' ';
-    if (request->method == UNKNOWN_HTTP_METHOD) {
-        return INVALID_HTTP_REQUEST;
-    }
-
-    start = end + 1;
-    end = strstr(start, " ");
-    if (end == NULL) {
-        log_error("request first line is invalid");
-        return INVALID_HTTP_REQUEST;
-    }
-    *end = '\0';
-    request->path = strdup(start);
-    *end = ' ';
-    if (request->path == NULL) {
-        log_error("http_request_parse_first_line strdup() path: %s", strerror(errno));
-        return errno;
-    }
-
-    start = end + 1;
-    request->proto = strdup(start);
-    if (request->path == NULL) {
-        log_error("http_request_parse_first_line strdup() path: %s", strerror(errno));
-        free(request->path);
-        return EXIT_FAILURE;
-    }
-
-    return EXIT_SUCCESS;
-}
-
-static int http_request_parse_headers_and_body(http_request_t request, char **lines, const size_t n) {
-    int rc = EXIT_SUCCESS;
-    for (size_t i = 1; i < n - 1; i++) {
-        if ((rc = http_headers_create_header(request->headers, lines[i])) != EXIT_SUCCESS) {
-            return rc;
-        }
-    }
-
-    bool body_exists = false;
-    char *value = NULL;
-    rc = http_headers_find_header(request->headers, "Content-Type", &value);
-    if (rc == EXIT_SUCCESS) {
-        rc = http_headers_find_header(request->headers, "Content-Length", &value);
-        if (rc == EXIT_SUCCESS) {
-            body_exists = true;
-        }
-    } else if (rc != HTTP_HEADER_NOT_FOUND) {
-        return rc;
-    }
-
-    if (body_exists) {
-        request->body = strdup(lines[n - 1]);
-        if (request->body == NULL) {
-            log_error("http_request_create strdup() body: %s", strerror(errno));
-            return errno;
-        }
-    } else {
-        request->body = NULL;
-        if ((rc = http_headers_create_header(request->headers, lines[n - 1])) != EXIT_SUCCESS) {
-            return rc;
-        }
-    }
-
-    return EXIT_SUCCESS;
-}
-
-int http_request_create(http_request_t *request, const char *raw_request) {
+int http_request_create(http_request_t *request, arena_t arena, char *raw_request, const http_parser_t *head) {
     clock_t start_time = clock();
 
-    char **lines = NULL;
-    size_t n = 0;
-    int rc = http_request_parse_lines(raw_request, &lines, &n);
-    if (rc != EXIT_SUCCESS) {
-        goto exit;
+    http_method_t method = http_request_parse_method(raw_request + head->method.offset, head->method.length);
+    if (method == UNKNOWN_HTTP_METHOD) {
+        return INVALID_HTTP_REQUEST;
     }
-    if (n == 0) {
-        log_error("raw_request is invalid");
-        rc = INVALID_HTTP_REQUEST;
-        goto free_lines;
+    if (head->proto.length != 8 || strncmp(raw_request + head->proto.offset, "HTTP/1.", 7) != 0) {
+        log_error("http request has unsupported protocol");
+        return INVALID_HTTP_REQUEST;
     }
 
-    http_request_t tmp_request = malloc(sizeof(struct http_request));
+    http_request_t tmp_request = arena_alloc(arena, sizeof(struct http_request));
     if (tmp_request == NULL) {
-        log_error("http_request_create malloc() http_request: %s", strerror(errno));
-        rc = EXIT_FAILURE;
-        goto free_lines;
+        log_error("http_request_create arena_alloc() http_request: %s", strerror(errno));
+        return errno;
     }
+    tmp_request->method = method;
+    tmp_request->raw = raw_request;
+    tmp_request->head = *head;
     tmp_request->start_time = start_time;
+    *request = tmp_request;
 
-    if ((rc = http_request_parse_first_line(tmp_request, lines[0])) != EXIT_SUCCESS) {
-        goto free_request;
-    }
-
-    if ((rc = http_headers_create(&tmp_request->headers, AVERAGE_HTTP_HEADERS_COUNT)) != EXIT_SUCCESS) {
-        goto free_request_first_line;
-    }
-
-    if ((rc = http_request_parse_headers_and_body(tmp_request, lines, n)) == EXIT_SUCCESS) {
-        *request = tmp_request;
-        goto free_lines;
-    }
-
-    http_headers_destroy(&tmp_request->headers);
-free_request_first_line:
-    free(tmp_request->path);
-    free(tmp_request->proto);
-free_request:
-    free(tmp_request);
-free_lines:
-    http_request_free_lines(lines, n);
-exit:
-    return rc;
+    return EXIT_SUCCESS;
 }
 
 int http_request_compute_processing_time_ms(http_request_t request, clock_t *diff) {
@@ -204,32 +63,53 @@ int http_request_get_method(http_request_t request, http_method_t *method) {
 }
 
 int http_request_get_path(http_request_t request, char **path) {
-    *path = request->path;
+    *path = request->raw + request->head.path.offset;
     return EXIT_SUCCESS;
 }
 
 int http_request_get_proto(http_request_t request, char **proto) {
-    *proto = request->proto;
+    *proto = request->raw + request->head.proto.offset;
     return EXIT_SUCCESS;
 }
 
-int http_request_find_header(http_request_t request, const char *name, char **value) {
-    return http_headers_find_header(request->headers, name, value);
-}
+int http_request_get_header(http_request_t request, http_known_header_t header, char **value) {
+    uint8_t slot = request->head.known_headers[header];
+    if (slot == 0) {
+        return HTTP_HEADER_NOT_FOUND;
+    }
 
-int http_request_get_body(http_request_t request, char **body) {
-    *body = request->body;
+    *value = request->raw + request->head.header_values[slot - 1].offset;
     return EXIT_SUCCESS;
 }
 
+int http_request_find_header(http_request_t request, const char *name, char **value) {
+    size_t len = strlen(name);
+    http_known_header_t known = http_known_header_of(name, len);
+    if (known != HTTP_HEADER_UNKNOWN) {
+        return http_request_get_header(request, known, value);
+    }
+
+    uint32_t hash = HTTP_HEADER_HASH_SEED;
+    for (const char *p = name; *p != '\0'; p++) {
+        hash = http_header_hash_step(hash, *p);
+    }
+    for (uint32_t i = hash;; i++) {
+        uint8_t slot = request->head.unknown_headers[i & (HTTP_UNKNOWN_HEADER_SLOTS - 1)];
+        if (slot == 0) {
+            return HTTP_HEADER_NOT_FOUND;
+        }
+        http_slice_t cur_name = request->head.header_names[slot - 1];
+        if (cur_name.length == len && strncasecmp(request->raw + cur_name.offset, name, len) == 0) {
+            *value = request->raw + request->head.header_values[slot - 1].offset;
+            return EXIT_SUCCESS;
+        }
+    }
+}
+
+// The memory goes back with arena_reset(); only the handle is cleared.
 void http_request_destroy(http_request_t *request) {
-    if (request == NULL || *request == NULL) {
+    if (request == NULL) {
         return;
     }
-    free((*request)->path);
-    free((*request)->proto);
-    http_headers_destroy(&(*request)->headers);
-    free((*request)->body);
-    free(*request);
     *request = NULL;
 }
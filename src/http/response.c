@@ -1,38 +1,78 @@
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
+#include <sys/socket.h>
 #include "response.h"
 #include "headers.h"
+#include "prebuilt_responses.h"
 #include "fs.h"
 #include "log.h"
 
 struct http_response {
+    arena_t arena;
     http_proto_t proto;
     http_status_code_t status_code;
     http_headers_t headers;
-    char *body;
+    const char *body;
+    size_t body_length;
+    file_cache_entry_t cached;
+    compressed_variant_t compressed;
     int attachment_fd;
+    off_t attachment_offset;
+    size_t attachment_size;
+    const http_body_part_t *parts;
+    size_t parts_count;
+    const char *parts_trailer;
+    // Progress of a body that did not fit into the socket at once: whole parts, bytes of the current one, and
+    // bytes of the trailer. A single attachment advances attachment_offset and attachment_size instead.
+    size_t parts_sent;
+    size_t part_sent;
+    size_t trailer_sent;
+    const http_prebuilt_response_t *prebuilt;
+    bool prebuilt_body;
+    bool keep_alive;
 };
 
-int http_response_create(http_response_t *response) {
-    http_response_t tmp_response = calloc(1, sizeof(struct http_response));
+int http_response_create(http_response_t *response, arena_t arena) {
+    http_response_t tmp_response = arena_alloc(arena, sizeof(struct http_response));
     if (tmp_response == NULL) {
-        log_error("http_response_create malloc() response: %s", strerror(errno));
+        log_error("http_response_create arena_alloc() response: %s", strerror(errno));
         return errno;
     }
+    memset(tmp_response, 0, sizeof(struct http_response));
 
-    int rc = http_headers_create(&tmp_response->headers, AVERAGE_HTTP_HEADERS_COUNT);
+    int rc = http_headers_create(&tmp_response->headers, arena, AVERAGE_HTTP_HEADERS_COUNT);
     if (rc != EXIT_SUCCESS) {
-        free(tmp_response);
         return rc;
     }
 
+    tmp_response->arena = arena;
     tmp_response->attachment_fd = -1;
     *response = tmp_response;
 
     return EXIT_SUCCESS;
 }
 
+int http_response_create_prebuilt(http_response_t *response, arena_t arena,
+                                  const http_prebuilt_response_t *prebuilt, bool with_body) {
+    http_response_t tmp_response = arena_alloc(arena, sizeof(struct http_response));
+    if (tmp_response == NULL) {
+        log_error("http_response_create_prebuilt arena_alloc() response: %s", strerror(errno));
+        return errno;
+    }
+    memset(tmp_response, 0, sizeof(struct http_response));
+
+    tmp_response->arena = arena;
+    tmp_response->proto = HTTP_1_1;
+    tmp_response->status_code = prebuilt->status_code;
+    tmp_response->attachment_fd = -1;
+    tmp_response->prebuilt = prebuilt;
+    tmp_response->prebuilt_body = with_body;
+    *response = tmp_response;
+
+    return EXIT_SUCCESS;
+}
+
 int http_response_set_proto(http_response_t response, http_proto_t proto) {
     response->proto = proto;
     return EXIT_SUCCESS;
@@ -47,27 +87,103 @@ int http_response_set_header(http_response_t response, const char *name, const c
     return http_headers_set_header(response->headers, name, value);
 }
 
+int http_response_set_keep_alive(http_response_t response, bool keep_alive) {
+    if (response->prebuilt != NULL) {
+        response->keep_alive = keep_alive;
+        return EXIT_SUCCESS;
+    }
+
+    return http_response_set_header(response, "Connection", keep_alive ? "keep-alive" : "close");
+}
+
 int http_response_set_body(http_response_t response, const char *body) {
-    char *tmp_body = strdup(body);
+    char *tmp_body = arena_strdup(response->arena, body);
     if (tmp_body == NULL) {
-        log_error("http_response_set_body strdup() body: %s", strerror(errno));
+        log_error("http_response_set_body arena_strdup() body: %s", strerror(errno));
         return errno;
     }
 
-    free(response->body);
     response->body = tmp_body;
+    response->body_length = strlen(tmp_body);
+
+    return EXIT_SUCCESS;
+}
+
+int http_response_set_cached_body(http_response_t response, file_cache_entry_t entry) {
+    const char *data = NULL;
+    size_t length = 0;
+    int fd = -1;
+    int rc = file_cache_entry_get_data(entry, &data, &length);
+    if (rc != EXIT_SUCCESS) {
+        return rc;
+    }
+    if ((rc = file_cache_entry_get_fd(entry, &fd)) != EXIT_SUCCESS) {
+        return rc;
+    }
+
+    if (data != NULL) {
+        response->body = data;
+        response->body_length = length;
+    } else {
+        response->body = NULL;
+        response->attachment_fd = fd;
+        response->attachment_size = length;
+    }
+    response->cached = entry;
 
     return EXIT_SUCCESS;
 }
 
-int http_response_set_attachment(http_response_t response, int fd) {
-    free(response->body);
+int http_response_set_compressed_body(http_response_t response, compressed_variant_t variant) {
+    int rc = compressed_variant_get_data(variant, &response->body, &response->body_length);
+    if (rc != EXIT_SUCCESS) {
+        return rc;
+    }
+    response->compressed = variant;
+
+    return EXIT_SUCCESS;
+}
+
+int http_response_set_attachment(http_response_t response, int fd, size_t size) {
+    response->body = NULL;
     response->attachment_fd = fd;
+    response->attachment_size = size;
+
+    return EXIT_SUCCESS;
+}
+
+int http_response_select_range(http_response_t response, off_t offset, size_t length) {
+    if (response->body != NULL) {
+        response->body += offset;
+        response->body_length = length;
+    } else {
+        response->attachment_offset = offset;
+        response->attachment_size = length;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int http_response_select_parts(http_response_t response, const http_body_part_t *parts, size_t count,
+                               const char *trailer) {
+    response->parts = parts;
+    response->parts_count = count;
+    response->parts_trailer = trailer;
 
     return EXIT_SUCCESS;
 }
 
 int http_response_close_attachment(http_response_t response) {
+    if (response->cached != NULL) {
+        // A cached descriptor is shared with other responses and closed by the cache.
+        response->body = NULL;
+        response->attachment_fd = -1;
+        file_cache_release(&response->cached);
+    }
+    if (response->compressed != NULL) {
+        response->body = NULL;
+        compressed_variant_release(&response->compressed);
+    }
     if (response->attachment_fd != -1) {
         close(response->attachment_fd);
         response->attachment_fd = -1;
@@ -89,116 +205,168 @@ static int http_response_check(http_response_t response) {
     return EXIT_SUCCESS;
 }
 
-static int http_response_write_status_line(http_response_t response, int fd) {
-    if (write(fd, response->proto, strlen(response->proto)) != (ssize_t)strlen(response->proto)) {
-        log_error("http_response_write write proto %s to fd %d: %s", response->proto, fd, strerror(errno));
-        return errno;
-    }
-
-    if (write(fd, " ", 1) != 1) {
-        log_error("http_response_write write space to fd %d: %s", fd, strerror(errno));
-        return errno;
-    }
+static char *append(char *dst, const char *src, size_t len) {
+    memcpy(dst, src, len);
+    return dst + len;
+}
 
-    if (write(fd, response->status_code, strlen(response->status_code)) != (ssize_t)strlen(response->status_code)) {
-        log_error("http_response_write write status_code %s to fd %d: %s", response->status_code, fd, strerror(errno));
-        return errno;
+static int http_response_header_at(http_response_t response, size_t index, char **name, char **value) {
+    http_header_t header;
+    int rc = http_headers_at(response->headers, index, &header);
+    if (rc != EXIT_SUCCESS) {
+        return rc;
     }
-
-    if (write(fd, "\r\n", 2) != 2) {
-        log_error("http_response_write write \\r\\n to fd %d: %s", fd, strerror(errno));
-        return errno;
+    if ((rc = http_header_get_name(header, name)) != EXIT_SUCCESS) {
+        return rc;
     }
 
-    return EXIT_SUCCESS;
+    return http_header_get_value(header, value);
 }
 
-static int http_response_write_headers(http_headers_t headers, int fd) {
-    int rc;
+// Serializes the status line and the headers into one arena buffer, so the head goes out as a single piece.
+static int http_response_serialize_head(http_response_t response, char **head, size_t *length) {
     size_t headers_count = 0;
-    if ((rc = http_headers_size(headers, &headers_count)) != EXIT_SUCCESS) {
+    int rc = http_headers_size(response->headers, &headers_count);
+    if (rc != EXIT_SUCCESS) {
         return rc;
     }
 
+    size_t proto_len = strlen(response->proto);
+    size_t status_code_len = strlen(response->status_code);
+    size_t total = proto_len + 1 + status_code_len + 2 + 2;
     for (size_t i = 0; i < headers_count; i++) {
-        http_header_t cur_header;
-        if ((rc = http_headers_at(headers, i, &cur_header)) != EXIT_SUCCESS) {
-            return rc;
-        }
-
-        char *raw_header = NULL;
-        if ((rc = http_header_make_raw(cur_header, &raw_header)) != EXIT_SUCCESS) {
+        char *name = NULL, *value = NULL;
+        if ((rc = http_response_header_at(response, i, &name, &value)) != EXIT_SUCCESS) {
             return rc;
         }
+        total += strlen(name) + 2 + strlen(value) + 2;
+    }
 
-        ssize_t n = write(fd, raw_header, strlen(raw_header));
-        ssize_t raw_len = strlen(raw_header);
-        http_header_destroy_raw(&raw_header);
-        if (n != raw_len) {
-            log_error("http_response_write write header %s to fd %d: %s", raw_header, fd, strerror(errno));
-            return errno;
-        }
+    char *buf = arena_alloc(response->arena, total);
+    if (buf == NULL) {
+        log_error("http_response_serialize_head arena_alloc(): %s", strerror(errno));
+        return errno;
+    }
 
-        if (write(fd, "\r\n", 2) != 2) {
-            log_error("http_response_write write \\r\\n to fd %d: %s", fd, strerror(errno));
-            return errno;
+    char *p = buf;
+    p = append(p, response->proto, proto_len);
+    p = append(p, " ", 1);
+    p = append(p, response->status_code, status_code_len);
+    p = append(p, "\r\n", 2);
+    for (size_t i = 0; i < headers_count; i++) {
+        char *name = NULL, *value = NULL;
+        if ((rc = http_response_header_at(response, i, &name, &value)) != EXIT_SUCCESS) {
+            return rc;
         }
+        p = append(p, name, strlen(name));
+        p = append(p, ": ", 2);
+        p = append(p, value, strlen(value));
+        p = append(p, "\r\n", 2);
     }
+    append(p, "\r\n", 2);
+
+    *head = buf;
+    *length = total;
 
     return EXIT_SUCCESS;
 }
 
-static int http_response_write_body(http_response_t response, int fd) {
-    if (response->body != NULL || response->attachment_fd != -1) {
-        if (write(fd, "\r\n", 2) != 2) {
-            log_error("http_response_write write \\r\\n\\r\\n to fd %d: %s", fd, strerror(errno));
-            return errno;
-        }
-    } else {
+int http_response_head_iov(http_response_t response, struct iovec *iov, size_t capacity, size_t *n) {
+    int rc;
+    if ((rc = http_response_check(response)) != EXIT_SUCCESS) {
+        return rc;
+    }
+    if (capacity < HTTP_RESPONSE_IOV_COUNT) {
+        return ENOBUFS;
+    }
+    if (response->prebuilt != NULL) {
+        iov[0].iov_base = response->prebuilt->raw[response->keep_alive];
+        iov[0].iov_len = response->prebuilt->head_length[response->keep_alive] +
+                         (response->prebuilt_body ? response->prebuilt->body_length : 0);
+        *n = 1;
         return EXIT_SUCCESS;
     }
 
-    if (response->body != NULL) {
-        if (write(fd, response->body, strlen(response->body)) != (ssize_t)strlen(response->body)) {
-            log_error("http_response_write write body to fd %d: %s", fd, strerror(errno));
-            return errno;
-        }
-        return EXIT_SUCCESS;
+    char *head = NULL;
+    size_t head_len = 0;
+    if ((rc = http_response_serialize_head(response, &head, &head_len)) != EXIT_SUCCESS) {
+        return rc;
     }
 
-    int rc;
-    if (response->attachment_fd != -1) {
-        if ((rc = copy_file(response->attachment_fd, fd)) != EXIT_SUCCESS) {
-            return rc;
-        }
+    size_t i = 0;
+    iov[i].iov_base = head;
+    iov[i++].iov_len = head_len;
+    if (response->body != NULL && response->parts == NULL) {
+        iov[i].iov_base = (void *)response->body;
+        iov[i++].iov_len = response->body_length;
     }
+    *n = i;
 
     return EXIT_SUCCESS;
 }
 
-int http_response_write(http_response_t response, int fd) {
+bool http_response_has_attachment(http_response_t response) {
+    return response->attachment_fd != -1 || response->parts != NULL;
+}
+
+// Each part head is corked onto the slice that follows it; slices go out from the descriptor at their offsets,
+// or straight from the cached content, so no part is copied into a buffer of its own.
+static int http_response_write_parts(http_response_t response, int fd) {
     int rc;
-    if ((rc = http_response_check(response)) != EXIT_SUCCESS) {
-        return rc;
+    for (; response->parts_sent < response->parts_count; response->parts_sent++, response->part_sent = 0) {
+        const http_body_part_t *part = &response->parts[response->parts_sent];
+        struct iovec iov[2] = {
+            {.iov_base = (void *)part->head, .iov_len = part->head_length},
+        };
+        size_t n = 1;
+        if (response->attachment_fd == -1) {
+            iov[n].iov_base = (void *)(response->body + part->offset);
+            iov[n++].iov_len = part->length;
+        }
+        if ((rc = send_iov(fd, iov, n, &response->part_sent, MSG_MORE)) != EXIT_SUCCESS) {
+            if (rc != EAGAIN) {
+                log_error("http_response_write_parts sendmsg() to fd %d: %s", fd, strerror(rc));
+            }
+            return rc;
+        }
+        if (response->attachment_fd != -1) {
+            size_t slice_sent = response->part_sent - part->head_length;
+            off_t offset = part->offset + (off_t)slice_sent;
+            size_t count = part->length - slice_sent;
+            rc = send_file(response->attachment_fd, fd, &offset, &count);
+            response->part_sent = part->head_length + part->length - count;
+            if (rc != EXIT_SUCCESS) {
+                return rc;
+            }
+        }
     }
 
-    if ((rc = http_response_write_status_line(response, fd)) != EXIT_SUCCESS) {
+    struct iovec trailer = {.iov_base = (void *)response->parts_trailer, .iov_len = strlen(response->parts_trailer)};
+    if ((rc = send_iov(fd, &trailer, 1, &response->trailer_sent, 0)) != EXIT_SUCCESS) {
+        if (rc != EAGAIN) {
+            log_error("http_response_write_parts sendmsg() to fd %d: %s", fd, strerror(rc));
+        }
         return rc;
     }
 
-    if ((rc = http_response_write_headers(response->headers, fd)) != EXIT_SUCCESS) {
-        return rc;
+    return EXIT_SUCCESS;
+}
+
+int http_response_write_attachment(http_response_t response, int fd) {
+    if (response->parts != NULL) {
+        return http_response_write_parts(response, fd);
+    }
+    if (response->attachment_fd == -1) {
+        return EXIT_SUCCESS;
     }
 
-    return http_response_write_body(response, fd);
+    return send_file(response->attachment_fd, fd, &response->attachment_offset, &response->attachment_size);
 }
 
+// The memory goes back with arena_reset(); an attachment has to be closed separately.
 void http_response_destroy(http_response_t *response) {
-    if (response == NULL || *response == NULL) {
+    if (response == NULL) {
         return;
     }
-    http_headers_destroy(&(*response)->headers);
-    free((*response)->body);
-    free(*response);
     *response = NULL;
 }
@@ -0,0 +1,48 @@
+#include <stdbool.h>
+#include "scanner.h"
+
+#if defined(__x86_64__)
+#include <emmintrin.h>
+#define HTTP_SCANNER_X86
+#endif
+
+static bool is_delimiter(char c, char limit) {
+    return (unsigned char)c <= (unsigned char)limit || c == 0x7f;
+}
+
+static uint32_t scan_scalar(const char *data, uint32_t from, uint32_t to, char limit) {
+    for (uint32_t i = from; i < to; i++) {
+        if (is_delimiter(data[i], limit)) {
+            return i;
+        }
+    }
+
+    return to;
+}
+
+#ifdef HTTP_SCANNER_X86
+// A byte is at most limit exactly when the unsigned max of both is limit.
+static uint32_t scan_sse2(const char *data, uint32_t from, uint32_t to, char limit) {
+    const __m128i limits = _mm_set1_epi8(limit);
+    const __m128i del = _mm_set1_epi8(0x7f);
+    uint32_t i = from;
+    for (; i + 16 <= to; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(data + i));
+        __m128i low = _mm_cmpeq_epi8(_mm_max_epu8(chunk, limits), limits);
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_or_si128(low, _mm_cmpeq_epi8(chunk, del)));
+        if (mask != 0) {
+            return i + (uint32_t)__builtin_ctz(mask);
+        }
+    }
+
+    return scan_scalar(data, i, to, limit);
+}
+#endif
+
+uint32_t http_scan_delimiter(const char *data, uint32_t from, uint32_t to, char limit) {
+#ifdef HTTP_SCANNER_X86
+    return scan_sse2(data, from, to, limit);
+#else
+    return scan_scalar(data, from, to, limit);
+#endif
+}
@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <sys/socket.h>
 #include <unistd.h>
@@ -6,105 +7,209 @@
 #include <pthread.h>
 #include <errno.h>
 
+#include "config.h"
 #include "server.h"
 #include "thread_pool.h"
+#include "cpu_affinity.h"
 #include "events_handler.h"
+#include "prebuilt_responses.h"
+#include "file_cache.h"
+#include "compression.h"
+#include "mime_types.h"
+#include "decisions_maker.h"
 #include "log.h"
 
-#define PORT 8080
-#define REQUEST_BUFFER_SIZE 1024
-#define THREAD_POOL_SIZE 7
-#define CONN_QUEUE_LEN 1024
-
 static server_t server = NULL;
 static thread_pool_t thread_pool = NULL;
+// Worker that last served each connection plus one, or 0; its follow-up requests are queued back to that worker.
+static uint16_t *connection_workers = NULL;
+static size_t connection_workers_count = 0;
+// Signal that stopped the server, or 0.
+static volatile sig_atomic_t stop_signal = 0;
+
+// Serves the request that woke the socket up and either hands the socket back to the server or closes it.
+// Returns whether the socket was kept.
+static bool serve_request(int socket_fd) {
+    http_event_next_t next = HTTP_EVENT_CLOSE;
+    handle_http_event(socket_fd, &next);
+    if (next == HTTP_EVENT_CLOSE || server_resume(server, socket_fd, next == HTTP_EVENT_WRITE) != EXIT_SUCCESS) {
+        http_events_close(socket_fd);
+        return false;
+    }
+    return true;
+}
+
+void serve_connection(int socket_fd) {
+    serve_request(socket_fd);
+}
+
+static void set_connection_worker(int socket_fd, size_t worker) {
+    if ((size_t)socket_fd < connection_workers_count) {
+        __atomic_store_n(&connection_workers[socket_fd], (uint16_t)(worker + 1), __ATOMIC_RELAXED);
+    }
+}
 
-typedef struct task {
-    int socket_fd;
-} task_t;
+static size_t get_connection_worker(int socket_fd) {
+    if ((size_t)socket_fd >= connection_workers_count) {
+        return THREAD_POOL_ANY_WORKER;
+    }
+    uint16_t worker = __atomic_load_n(&connection_workers[socket_fd], __ATOMIC_RELAXED);
+    return worker > 0 ? (size_t)worker - 1 : THREAD_POOL_ANY_WORKER;
+}
 
 void *worker_thread(void *arg) {
     thread_pool_t pool = (thread_pool_t)arg;
-    pthread_cleanup_push(thread_pool_cleanup_handler, pool);
-    int rc;
     while (1) {
-        void *task = NULL;
-        if ((rc = thread_pool_take_task(&task, pool)) != EXIT_SUCCESS) {
-            log_error("thread_pool_take_task(): %s", strerror(errno));
-            pthread_exit(&rc);
+        thread_pool_task_t task;
+        if (thread_pool_take_task(&task, pool) != EXIT_SUCCESS) {
+            break;
         }
-        int client_socket = ((task_t *)task)->socket_fd;
+        int client_socket = task.socket_fd;
 
-        handle_http_event(client_socket);
-
-        close(client_socket);
-        ((task_t *)task)->socket_fd = -1;
-        free(task);
+        // Recorded before the socket goes back to the server, which may hand it out again right away.
+        set_connection_worker(client_socket, thread_pool_current_worker());
+        if (!serve_request(client_socket)) {
+            set_connection_worker(client_socket, THREAD_POOL_ANY_WORKER);
+        }
     }
-    pthread_cleanup_pop(0);
+    return NULL;
 }
 
 void handle_request(int socket_fd) {
-    task_t *task = malloc(sizeof(task_t));
-    if (task == NULL) {
-        log_error("handle_request(fd = %d) malloc (): %s", socket_fd, strerror(errno));
-        log_info("request(fd = %d) cannot be handled; skip", socket_fd);
-        return;
-    }
-    task->socket_fd = socket_fd;
-    thread_pool_submit(thread_pool, task);
+    thread_pool_task_t task = {.socket_fd = socket_fd};
+    size_t worker = get_connection_worker(socket_fd);
+    if (worker == THREAD_POOL_ANY_WORKER) {
+        // A new connection: the worker pinned to the cpu that received it, if any.
+        size_t slot = cpu_affinity_slot_of_socket(socket_fd);
+        if (slot != CPU_AFFINITY_NO_SLOT) {
+            worker = slot;
+        }
+    }
+    if (thread_pool_submit(thread_pool, worker, task) != EXIT_SUCCESS) {
+        log_info("request(fd = %d) cannot be handled; close", socket_fd);
+        http_events_close(socket_fd);
+    }
 }
 
 void server_shutdown(server_t s)
 {
     log_info("shutdown server...");
 
-    thread_pool_stop(thread_pool);
-    thread_pool_destroy(&thread_pool);
+    if (thread_pool != NULL) {
+        size_t live_workers, idle_workers;
+        thread_pool_get_size(thread_pool, &live_workers, &idle_workers);
+        log_info("thread pool: %lu workers, %lu idle", live_workers, idle_workers);
+        thread_pool_stop(thread_pool);
+        thread_pool_destroy(&thread_pool);
+    }
+    free(connection_workers);
 
     server_stop(s);
     server_destroy(&s);
+    http_events_destroy();
+    http_prebuilt_responses_destroy();
+    file_cache_destroy();
+    compression_destroy();
+    mime_types_destroy();
+    cpu_affinity_destroy();
 
     log_info("server stopped");
-    exit(EXIT_SUCCESS);
 }
 
+// Only records the signal and wakes the reactors: the shutdown runs on the main thread once server_run() returns.
 void signal_handler(int signum)
 {
-    switch (signum) {
-        case SIGINT:
-            log_debug("Signal SIGINT received");
-            server_shutdown(server);
-            break;
-        case SIGTERM:
-            log_debug("Signal SIGTERM received");
-            server_shutdown(server);
-            break;
-        default:
-            log_debug("unknown signal received: %d", signum);
-    }
+    stop_signal = signum;
+    server_interrupt(server);
 }
 
 int main(void) {
     log_set_level(LOG_DEBUG);
+    // Records still queued are written on exit.
+    if (log_start_async() == 0) {
+        atexit(log_stop_async);
+    }
     int rc;
-    if ((rc = server_create(&server)) != EXIT_SUCCESS) {
+    config_t config;
+    if ((rc = config_load(&config)) != EXIT_SUCCESS) {
         return rc;
     }
-    if ((rc = thread_pool_create(&thread_pool, THREAD_POOL_SIZE)) != 0) {
+
+    void (*request_handler)(int) = handle_request;
+    size_t reactors = 1;
+    if (config.mode == SERVER_MODE_REACTORS) {
+        // Reactor mode: the connection is served on the reactor thread that accepted it.
+        request_handler = serve_connection;
+        reactors = config.reactors;
+    }
+
+    if ((rc = http_prebuilt_responses_init(config.error_pages)) != EXIT_SUCCESS) {
         return rc;
     }
 
-    if ((rc = thread_pool_start(thread_pool, worker_thread)) != EXIT_SUCCESS) {
+    if ((rc = cpu_affinity_init(config.cpu_affinity)) != EXIT_SUCCESS) {
         return rc;
     }
 
+    if ((rc = mime_types_init(config.mime_types, config.default_type, config.charset)) != EXIT_SUCCESS) {
+        return rc;
+    }
+
+    if ((rc = file_cache_init(STATIC_PATH, config.file_cache_size, config.file_cache_entries,
+                              config.file_cache_max_file_size, config.open_file_cache_size)) != EXIT_SUCCESS) {
+        return rc;
+    }
+
+    if ((rc = compression_init(config.compression_level, config.compression_min_size,
+                               config.compression_cache_size)) != EXIT_SUCCESS) {
+        return rc;
+    }
+
+    if ((rc = http_events_init(config.max_connections, config.keep_alive_requests)) != EXIT_SUCCESS) {
+        return rc;
+    }
+
+    if ((rc = server_create(&server, reactors, config.backend, config.max_connections,
+                            config.mode == SERVER_MODE_REACTORS && config.cpu_affinity != CPU_AFFINITY_OFF)) != EXIT_SUCCESS) {
+        return rc;
+    }
+
+    if (config.mode == SERVER_MODE_POOL) {
+        if ((rc = thread_pool_create(&thread_pool, config.min_workers, config.max_workers, config.queue_depth,
+                                     config.spawn_latency_us, config.worker_idle_timeout_ms)) != 0) {
+            return rc;
+        }
+
+        if ((connection_workers = calloc(config.max_connections, sizeof(uint16_t))) == NULL) {
+            log_error("calloc() connection_workers: %s", strerror(errno));
+            return errno;
+        }
+        connection_workers_count = config.max_connections;
+
+        if ((rc = thread_pool_start(thread_pool, worker_thread)) != EXIT_SUCCESS) {
+            return rc;
+        }
+    }
+
+    signal(SIGPIPE, SIG_IGN);
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
 
-    if ((rc = server_run(server, PORT, CONN_QUEUE_LEN, handle_request)) != EXIT_SUCCESS) {
-        return rc;
+    rc = server_run(server, config.port, config.conn_queue_len, config.keep_alive_timeout_ms, request_handler);
+    switch (stop_signal) {
+        case SIGINT:
+            log_debug("Signal SIGINT received");
+            break;
+        case SIGTERM:
+            log_debug("Signal SIGTERM received");
+            break;
+        default:
+            break;
     }
+    // The server is freed below; a second signal terminates the process instead.
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    server_shutdown(server);
 
-    return EXIT_SUCCESS;
+    return rc;
 }